@@ -0,0 +1,112 @@
+#pragma once
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include "../slterrain.h"
+#include "mapoutput.h"
+
+// Runs output jobs (colour mapping, encoding, writing files) on its own thread so the simulation
+// can carry on with the next year. Jobs only touch copies taken on the caller's thread, never the
+// terrain itself. At most maxQueued jobs wait; push blocks after that until the writer catches up,
+// so a slow disk slows the simulation down instead of filling memory with copies.
+// The destructor finishes everything still queued.
+class AsyncWriter {
+public:
+	AsyncWriter(int maxQueued = 2) : _maxQueued(std::max(1, maxQueued)), _thread([this] { run(); }) {}
+	~AsyncWriter() {
+		{
+			std::lock_guard<std::mutex> lock(_mutex);
+			_stopping = true;
+		}
+		_changed.notify_all();
+		_thread.join();
+	}
+	AsyncWriter(const AsyncWriter&) = delete;
+	AsyncWriter& operator=(const AsyncWriter&) = delete;
+
+	void push(std::function<void()> job) {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_changed.wait(lock, [this] { return (int)_jobs.size() < _maxQueued; });
+		_jobs.push_back(std::move(job));
+		_changed.notify_all();
+	}
+
+	// blocks until everything pushed so far is written
+	void wait() {
+		std::unique_lock<std::mutex> lock(_mutex);
+		_changed.wait(lock, [this] { return _jobs.empty() && !_busy; });
+	}
+
+private:
+	int _maxQueued;
+	std::mutex _mutex;
+	std::condition_variable _changed; // queue or busy changed, one for both sides (few waiters)
+	std::deque<std::function<void()>> _jobs;
+	bool _busy = false;
+	bool _stopping = false;
+	std::thread _thread; // last, so everything above exists before it starts
+
+	void run() {
+		while (true) {
+			std::function<void()> job;
+			{
+				std::unique_lock<std::mutex> lock(_mutex);
+				_changed.wait(lock, [this] { return !_jobs.empty() || _stopping; });
+				if (_jobs.empty()) {
+					return;
+				}
+				job = std::move(_jobs.front());
+				_jobs.pop_front();
+				_busy = true;
+			}
+			_changed.notify_all(); // room in the queue
+			job();
+			{
+				std::lock_guard<std::mutex> lock(_mutex);
+				_busy = false;
+			}
+			_changed.notify_all();
+		}
+	}
+};
+
+// saveTerrainToBitmap, with the layers copied now and drawn and written on the writer's thread
+inline void saveTerrainToBitmapAsync(AsyncWriter& writer, SLTerrain& terrain, std::string filePrefix = "") {
+	auto layers = std::make_shared<const BitmapLayers>(captureBitmapLayers(terrain));
+	writer.push([layers, filePrefix] { saveBitmapLayers(*layers, filePrefix); });
+}
+
+// SLTerrain::save, with the layers copied into memory now (uncompressed, so just copies) and
+// compressed and written on the writer's thread. the file is the same as save would write
+inline void saveTerrainAsync(AsyncWriter& writer, SLTerrain& terrain, std::string path) {
+	SLTerrain::SaveParams params = terrain.getSaveParams();
+	SLTerrain::SaveParams raw;
+	raw.compress = false;
+	std::ostringstream mem;
+	if (!terrain.save(mem, raw)) {
+		printf("::::ERROR:::: saveTerrainAsync-> could not copy the terrain\n");
+		return;
+	}
+	auto bytes = std::make_shared<const std::string>(mem.str());
+	int threads = terrain.getPipelineParams().threads;
+
+	writer.push([bytes, params, path, threads] {
+		SLContainerReader in;
+		in.setVerifyChecksums(false); // just written
+		std::ofstream fout(path, std::ios::binary);
+		if (!fout.is_open() || !in.open(bytes->data(), bytes->size())) {
+			printf("::::ERROR:::: saveTerrainAsync-> could not write %s\n", path.c_str());
+			return;
+		}
+		SLContainerWriter out(fout);
+		out.setCompression(params.compress, params.floatTolerance);
+		out.setThreads(threads);
+		if (!out.copyEntries(in) || !out.finish()) {
+			printf("::::ERROR:::: saveTerrainAsync-> could not write %s\n", path.c_str());
+		}
+	});
+}
@@ -0,0 +1,196 @@
+#include <stdio.h>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include "../slterrain.h"
+#include "mapoutput.h"
+#include "asyncwriter.h"
+#include "configloader.h"
+#include "terrainconfig.h"
+
+// Non-interactive batch generation over many seeds/parameter sets.
+//
+// USAGE: batch <jobs file> [workers] [output directory] [save binary (0/1)]
+//
+// Each non-empty line of the jobs file is one map. A line is either a bare seed ("59339")
+// or a list of config.ini overrides ("seed=12 age=500 width=1000").
+// Anything not overridden comes from config.ini, lines starting with # or ; are skipped.
+//
+// Maps are generated on a pool of workers (default: all cores). Each worker holds at most one
+// map at a time, so at most [workers] maps are in memory at once.
+// Every finished job writes its bitmaps (and a binary save if asked) as "job<N>-..." in the output
+// directory, and appends a timing/stats line to batch-results.csv there.
+// With checkpointYears set in config.ini, unfinished jobs leave a job<N>-checkpoint.slck that the
+// next batch run over the same output directory resumes from.
+
+struct BatchJob {
+    int id;
+    std::vector<std::pair<std::string, std::string>> overrides;
+};
+
+std::vector<BatchJob> loadJobs(std::string path) {
+    std::vector<BatchJob> jobs;
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        printf(":::::BATCH ERROR::::: could not open jobs file: %s\n", path.c_str());
+        return jobs;
+    }
+
+    std::string line;
+    while (std::getline(file, line)) {
+        if (line.empty() || line[0] == '#' || line[0] == ';') {
+            continue;
+        }
+        BatchJob job;
+        job.id = jobs.size();
+
+        std::stringstream tokens(line);
+        std::string token;
+        while (tokens >> token) {
+            size_t eq = token.find('=');
+            if (eq == std::string::npos) {
+                job.overrides.push_back({ "seed", token }); // bare seed
+            }
+            else {
+                job.overrides.push_back({ token.substr(0, eq), token.substr(eq + 1) });
+            }
+        }
+        if (job.overrides.size() > 0) {
+            jobs.push_back(job);
+        }
+    }
+    return jobs;
+}
+
+// one csv line of timing and basic stats for a finished map
+std::string jobStats(BatchJob& job, SLTerrain& terrain, double seconds) {
+    auto& z = terrain.getHydro().getHeightMapConst();
+    auto& terrainTypes = terrain.getTerrainTypes();
+    int rows = terrain.getRows();
+    int cols = terrain.getCols();
+
+    float minZ = z[0][0];
+    float maxZ = z[0][0];
+    double sumZ = 0;
+    int typeCounts[SLTerrain::URANIUM + 1] = {};
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            minZ = std::min(minZ, z[i][j]);
+            maxZ = std::max(maxZ, z[i][j]);
+            sumZ += z[i][j];
+            typeCounts[terrainTypes[i][j]]++;
+        }
+    }
+
+    std::stringstream ss;
+    ss << job.id << "," << terrain.getFBMParams().seed << "," << cols << "," << rows << ","
+        << terrain.getTerrainParams().age << "," << seconds << ","
+        << minZ << "," << maxZ << "," << sumZ / ((double)rows * cols);
+    for (int t = 0; t <= SLTerrain::URANIUM; t++) {
+        ss << "," << typeCounts[t];
+    }
+    return ss.str();
+}
+
+std::string statsHeader() {
+    SLTerrain names;
+    std::string header = "job,seed,width,height,age,seconds,minHeight,maxHeight,meanHeight";
+    for (int t = 0; t <= SLTerrain::URANIUM; t++) {
+        header += "," + names.getTerrainTypeName((SLTerrain::TerrainType)t);
+    }
+    return header;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2) {
+        printf("USAGE: batch <jobs file> [workers] [output directory] [save binary (0/1)]\n");
+        return 1;
+    }
+    std::string jobsPath = argv[1];
+    int workers = argc > 2 ? std::stoi(argv[2]) : (int)std::thread::hardware_concurrency();
+    std::string outDir = argc > 3 ? argv[3] : "batch";
+    bool saveBinary = argc > 4 ? std::stoi(argv[4]) != 0 : false;
+    if (workers < 1) { workers = 1; }
+
+    ConfigLoader baseConfig;
+    baseConfig.load();
+
+    std::vector<BatchJob> jobs = loadJobs(jobsPath);
+    if (jobs.size() == 0) {
+        printf(":::::BATCH ERROR::::: no jobs found in: %s\n", jobsPath.c_str());
+        return 1;
+    }
+    workers = std::min(workers, (int)jobs.size());
+
+    std::filesystem::create_directories(outDir);
+    std::ofstream results(outDir + "/batch-results.csv");
+    results << statsHeader() << "\n";
+    std::mutex resultsMutex;
+
+    printf("Batch: %d jobs on %d workers -> %s\n", (int)jobs.size(), workers, outDir.c_str());
+    auto batchStart = std::chrono::steady_clock::now();
+
+    // bitmaps and saves are written on one output thread while the workers start their next job
+    AsyncWriter writer(workers);
+
+    // workers pull the next job until none are left
+    std::atomic<int> nextJob(0);
+    auto worker = [&]() {
+        while (true) {
+            int jobIndex = nextJob++;
+            if (jobIndex >= (int)jobs.size()) { return; }
+            BatchJob& job = jobs[jobIndex];
+
+            ConfigLoader config = baseConfig;
+            for (auto& kv : job.overrides) {
+                config.set(kv.first, kv.second);
+            }
+            TerrainConfig tc = loadTerrainConfig(config);
+
+            std::string prefix = outDir + "/job" + std::to_string(job.id) + "-";
+            std::string checkpoint = prefix + "checkpoint.slck";
+
+            // pick up where a killed batch left off if this job has a checkpoint
+            auto start = std::chrono::steady_clock::now();
+            SLTerrain terrain;
+            terrain.setSaveParams(tc.save); // output settings, not part of the checkpoint
+            if (!std::filesystem::exists(checkpoint) || !terrain.resume(checkpoint)) {
+                terrain.setPipelineParams(tc.pipeline);
+                if (!tc.classifierRules.empty() && tc.classifierRules != "default") {
+                    terrain.loadClassifierRules(tc.classifierRules);
+                }
+                terrain.setCheckpointing(checkpoint, tc.checkpointYears);
+                terrain.newMap(tc.fbm, tc.terrain, tc.erosion);
+            }
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            std::filesystem::remove(checkpoint);
+            saveTerrainToBitmapAsync(writer, terrain, prefix);
+            if (saveBinary) {
+                saveTerrainAsync(writer, terrain, prefix + "seed" + std::to_string(terrain.getFBMParams().seed) + ".slt");
+            }
+
+            std::string stats = jobStats(job, terrain, seconds);
+            std::lock_guard<std::mutex> lock(resultsMutex);
+            results << stats << "\n";
+            results.flush(); // keep finished jobs if the batch is killed
+            printf("-->Batch job %d DONE in %.2fs\n", job.id, seconds);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for (int i = 0; i < workers; i++) {
+        pool.push_back(std::thread(worker));
+    }
+    for (auto& t : pool) {
+        t.join();
+    }
+    writer.wait();
+
+    double total = std::chrono::duration<double>(std::chrono::steady_clock::now() - batchStart).count();
+    printf("-->Batch COMPLETE. %d maps in %.2fs\n", (int)jobs.size(), total);
+    return 0;
+}
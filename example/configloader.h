@@ -7,8 +7,8 @@
 // WARNING: does not handle most errors or work with categories/subheadings
 class ConfigLoader {
 public:
-	void load() {
-		std::ifstream file("config.ini");
+	void load(std::string path = "config.ini") {
+		std::ifstream file(path);
 		if (file.is_open()) {
 			std::string line;
 			while (std::getline(file, line)) {
@@ -51,9 +51,11 @@ public:
 		return std::stof(get(key));
 	}
 
-private:
-	static std::unordered_map<std::string, std::string> _config;
-};
+	// override or add a value (e.g. per-job overrides in the batch program)
+	void set(std::string key, std::string value) {
+		_config[key] = value;
+	}
 
-// static member initialization
-std::unordered_map<std::string, std::string> ConfigLoader::_config;
\ No newline at end of file
+private:
+	std::unordered_map<std::string, std::string> _config; // per instance so loaders can be used on separate threads
+};
\ No newline at end of file
@@ -20,6 +20,179 @@ T SLAbs(T number) {
 	}
 	return number;
 }
+// ColorCategories compiled for one matching type, for colouring whole layers. Exact matching of
+// enums and small integer ranges is a table indexed by value; everything else is a sorted array of
+// stops found with a binary search, giving the same colours as the ColorCategories getters.
+// Gradated floats can also be quantized into a table of quantizeSteps colours between the first
+// and last stop (faster for long palettes, off by at most one step).
+template<typename T>
+class ColorLut {
+public:
+	ColorLut() {}
+	ColorLut(const std::unordered_map<T, SLColor>& colourMap, ColorGradientType type, int quantizeSteps = 0) : _type(type) {
+		std::vector<std::pair<T, SLColor>> stops(colourMap.begin(), colourMap.end());
+		std::sort(stops.begin(), stops.end(), [](const std::pair<T, SLColor>& a, const std::pair<T, SLColor>& b) { return a.first < b.first; });
+		for (auto& stop : stops) {
+			_keys.push_back(stop.first);
+			_colours.push_back(stop.second);
+		}
+		if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+			if (type == CGT_EXACT && !_keys.empty()) {
+				long long low = (long long)_keys.front();
+				long long high = (long long)_keys.back();
+				if (high - low < 65536) {
+					_tableStart = low;
+					_table.assign((size_t)(high - low + 1), Entry(SLColor(0, 0, 0, 0)));
+					for (size_t i = 0; i < _keys.size(); i++) {
+						_table[(size_t)((long long)_keys[i] - low)] = Entry(_colours[i]);
+					}
+				}
+			}
+		}
+		if constexpr (std::is_arithmetic<T>::value) {
+			for (auto& key : _keys) {
+				_values.push_back((float)key);
+			}
+			if (type == CGT_GRADATED && quantizeSteps > 0 && _values.size() >= 2) {
+				_quantizeStart = _values.front();
+				_quantizeScale = quantizeSteps / (_values.back() - _values.front());
+				for (int i = 0; i < quantizeSteps; i++) {
+					_quantized.push_back(Entry(gradated(_values.front() + (i + 0.5f) / _quantizeScale)));
+				}
+			}
+		}
+	}
+
+	SLColor color(T value) const {
+		if (!_table.empty()) {
+			return tableEntry(value).colour;
+		}
+		if (!_quantized.empty()) {
+			return quantizedEntry(value).colour;
+		}
+		switch (_type) {
+		case CGT_EXACT: return exact(value);
+		case CGT_CLOSEST: return closest(value);
+		default: return gradated(value);
+		}
+	}
+
+	// 24 bit pixel, blue first like the bitmap rows
+	void bgr(T value, unsigned char* out) const {
+		const unsigned char* src;
+		if (!_table.empty()) {
+			src = tableEntry(value).bgr;
+		} else if (!_quantized.empty()) {
+			src = quantizedEntry(value).bgr;
+		} else {
+			colorToBgr(color(value), out);
+			return;
+		}
+		out[0] = src[0];
+		out[1] = src[1];
+		out[2] = src[2];
+	}
+
+	static void colorToBgr(const SLColor& c, unsigned char* out) {
+		int r = c.r;
+		int g = c.g;
+		int b = c.b;
+		out[2] = (unsigned char)(r);
+		out[1] = (unsigned char)(g);
+		out[0] = (unsigned char)(b);
+	}
+
+private:
+	struct Entry {
+		SLColor colour;
+		unsigned char bgr[3] = { 0, 0, 0 };
+		Entry() {}
+		Entry(SLColor c) : colour(c) { colorToBgr(c, bgr); }
+	};
+
+	ColorGradientType _type = CGT_EXACT;
+	std::vector<T> _keys; // sorted, with their colours
+	std::vector<SLColor> _colours;
+	std::vector<float> _values; // keys as floats, what gradated matching works in
+	std::vector<Entry> _table; // exact matching, indexed by value - _tableStart
+	long long _tableStart = 0;
+	std::vector<Entry> _quantized;
+	float _quantizeStart = 0;
+	float _quantizeScale = 0;
+
+	const Entry& tableEntry(T value) const {
+		static const Entry missing(SLColor(0, 0, 0, 0));
+		long long i = (long long)value - _tableStart;
+		return i >= 0 && i < (long long)_table.size() ? _table[(size_t)i] : missing;
+	}
+
+	const Entry& quantizedEntry(T value) const {
+		float i = ((float)value - _quantizeStart) * _quantizeScale;
+		int last = (int)_quantized.size() - 1;
+		return _quantized[i > 0 ? (i < last ? (int)i : last) : 0]; // NaN to the first
+	}
+
+	SLColor exact(T value) const {
+		auto it = std::lower_bound(_keys.begin(), _keys.end(), value);
+		if (it == _keys.end() || !(*it == value)) { return SLColor(0, 0, 0, 0); } //no value for key
+		return _colours[it - _keys.begin()];
+	}
+
+	// index of the stop nearest to value, the lower one on ties (what a scan from the front finds)
+	int nearest(T value) const {
+		if constexpr (std::is_arithmetic<T>::value) {
+			int i = (int)(std::lower_bound(_values.begin(), _values.end(), (float)value) - _values.begin());
+			if (i == (int)_values.size()) { i--; }
+			while (i > 0 && SLAbs(_values[i - 1] - value) <= SLAbs(_values[i] - value)) {
+				i--;
+			}
+			return i;
+		}
+		return 0;
+	}
+
+	SLColor closest(T value) const {
+		if (_colours.empty()) { return SLColor(); }
+		return _colours[nearest(value)];
+	}
+
+	// same steps as ColorCategories::getColorGradated, so the colours come out bit for bit the same
+	SLColor gradated(T value) const {
+		if (_colours.empty()) { return SLColor(); }
+		if (_colours.size() < 2) { return _colours.back(); }
+		if constexpr (std::is_arithmetic<T>::value) {
+			if (value != value) { return _colours[0]; } // NaN
+			int closestValueIdx = nearest(value);
+
+			// is value at front or back of range?
+			bool isFront = closestValueIdx == _values.size() - 1 && value >= _values[closestValueIdx];
+			bool isBack = closestValueIdx == 0 && value <= _values[closestValueIdx];
+			if (isFront || isBack) {
+				return _colours[closestValueIdx];
+			}
+
+			// find distance to two closest values
+			float closestValue = _values[closestValueIdx];
+			int nextClosestValueIdx = closestValue < value ? closestValueIdx + 1 : closestValueIdx - 1;
+			float nextClosestValue = _values[nextClosestValueIdx];
+			float closestDist = SLAbs(closestValue - value);
+			float nextClosestDist = SLAbs(nextClosestValue - value);
+
+			// merge colours of two closest values
+			const SLColor& closest = _colours[closestValueIdx];
+			const SLColor& nextClosest = _colours[nextClosestValueIdx];
+			float sum = closestDist + nextClosestDist;
+			if (sum == 0) { closestDist = 1; }
+			else {
+				closestDist = 1 - (closestDist / sum);
+				nextClosestDist = 1 - (nextClosestDist / sum);
+			}
+			return SLColor(closest * closestDist + nextClosest * nextClosestDist);
+		}
+		return _colours[0];
+	}
+};
+
 // Template class for mapping values to colours.
 // Works with number types (including enums).
 // Can return exact colour for value, closest colour to value,
@@ -37,19 +210,28 @@ public:
 		_isSorted = false;
 	}
 
+	// the categories compiled for one type of matching, for colouring whole layers
+	ColorLut<T> compile(ColorGradientType type, int quantizeSteps = 0) const {
+		return ColorLut<T>(_colourMap, type, quantizeSteps);
+	}
+
 	SLColor getColorExact(T value) {
 		if (_colourMap.find(value) == _colourMap.end()) { return SLColor(0, 0, 0, 0); } //no value for key
 		return _colourMap[value];
 	}
 
+	// nearest key, the lower one on ties, same as compile(CGT_CLOSEST) (a NaN gets the lowest key too)
 	SLColor getColorClosest(T value) {
-		T minValue = (T)0;
-		for (auto& pair : _colourMap) {
-			if (SLAbs(pair.first - value) < SLAbs(minValue - value)) {
-				minValue = pair.first;
+		if (_colourMap.empty()) { return SLColor(); }
+		auto best = _colourMap.begin();
+		for (auto it = _colourMap.begin(); it != _colourMap.end(); ++it) {
+			auto dist = SLAbs((float)it->first - value);
+			auto bestDist = SLAbs((float)best->first - value);
+			if (dist < bestDist || (!(dist > bestDist) && it->first < best->first)) {
+				best = it;
 			}
 		}
-		return _colourMap[minValue];
+		return best->second;
 	}
 
 	SLColor getColorGradated(T value) {
@@ -114,72 +296,55 @@ private:
 
 // Takes values and colour categories to output an bmp with
 // colours that are an CGT_EXACT, CLOSESTS or CGT_GRADATED match with values.
+// Rows are coloured in bands (in parallel, threads at a time) straight into the 24 bit
+// output rows and each band is written out as soon as it's done, so a bitmap never sits
+// in memory whole.
 class BmpOutput {
 public:
+	BmpOutput(int threads = 1) : _threads(std::max(1, threads)) {}
+
 	// takes matrix of number values and outputs them as a bitmap according to colour categories
 	template<typename T>
-	void saveTerrainAsBitMap(std::vector<std::vector<T>>& _values, ColorCategories<T>& colorCategories, std::string file, ColorGradientType type) {
+	void saveTerrainAsBitMap(const std::vector<std::vector<T>>& _values, const ColorCategories<T>& colorCategories, std::string file, ColorGradientType type) {
 		int h = _values.size();
 		if (h == 0) { return; }
 		int w = _values[0].size();
 		if (w == 0) { return; }
 
-		std::vector<std::vector<SLColor>> colorMatrix(_values.size(), std::vector<SLColor>(_values[0].size(), SLColor()));
-
-		for (int i = 0; i < h; i++) {
+		ColorLut<T> lut = colorCategories.compile(type);
+		saveRows(w, h, file, [&](int i, unsigned char* bgr) {
+			const T* row = _values[i].data();
 			for (int j = 0; j < w; j++) {
-				SLColor c;
-				switch (type) {
-				case CGT_EXACT:
-					c = colorCategories.getColorExact(_values[i][j]);
-					break;
-				case CGT_CLOSEST:
-					c = colorCategories.getColorClosest(_values[i][j]);
-					break;
-				case CGT_GRADATED:
-					c = colorCategories.getColorGradated(_values[i][j]);
-					break;
-				}
-				colorMatrix[i][j] = c;
+				lut.bgr(row[j], bgr + j * 3);
 			}
-		}
-		saveColorMatrix(colorMatrix, file);
+		});
 	}
 
 	// save a matrix of RGB colours to a bitmap file (alpha ignored)
-	void saveColorMatrix(std::vector<std::vector<SLColor>>& colorMatrix, std::string file) {
-		// modified from https://stackoverflow.com/questions/2654480/writing-bmp-image-in-pure-c-c-without-other-libraries
+	void saveColorMatrix(const std::vector<std::vector<SLColor>>& colorMatrix, std::string file) {
 		int h = colorMatrix.size();
 		if (h == 0) { return; }
 		int w = colorMatrix[0].size();
 		if (w == 0) { return; }
 
-		FILE* f;
-		unsigned char* img = NULL;
-		int filesize = 54 + 3 * w * h;
-
-		img = (unsigned char*)malloc(3 * w * h);
-		memset(img, 0, 3 * w * h);
-
-		for (int i = 0; i < h; i++) {
+		saveRows(w, h, file, [&](int i, unsigned char* bgr) {
 			for (int j = 0; j < w; j++) {
-				int y = i;
-				int x = j;
-
-				SLColor c = colorMatrix[i][j];
-				int r = c.r;
-				int g = c.g;
-				int b = c.b;
-				
-				img[(x + y * w) * 3 + 2] = (unsigned char)(r);
-				img[(x + y * w) * 3 + 1] = (unsigned char)(g);
-				img[(x + y * w) * 3 + 0] = (unsigned char)(b);
+				ColorLut<float>::colorToBgr(colorMatrix[i][j], bgr + j * 3);
 			}
-		}
+		});
+	}
+
+	// writes a w x h bitmap whose rows are drawn by colorRow(row, bgr), 3 bytes per pixel blue first.
+	// colorRow is called from several threads at once, for different rows
+	void saveRows(int w, int h, std::string file, const std::function<void(int, unsigned char*)>& colorRow) {
+		// modified from https://stackoverflow.com/questions/2654480/writing-bmp-image-in-pure-c-c-without-other-libraries
+		if (w <= 0 || h <= 0) { return; }
+
+		FILE* f = nullptr;
+		int filesize = 54 + 3 * w * h;
 
 		unsigned char bmpfileheader[14] = { 'B','M', 0,0,0,0, 0,0, 0,0, 54,0,0,0 };
 		unsigned char bmpinfoheader[40] = { 40,0,0,0, 0,0,0,0, 0,0,0,0, 1,0, 24,0 };
-		unsigned char bmppad[3] = { 0,0,0 };
 
 		bmpfileheader[2] = (unsigned char)(filesize);
 		bmpfileheader[3] = (unsigned char)(filesize >> 8);
@@ -196,15 +361,165 @@ public:
 		bmpinfoheader[11] = (unsigned char)(h >> 24);
 
 		fopen_s(&f, file.c_str(), "wb");
+		if (!f) {
+			printf("::::ERROR:::: BmpOutput::saveRows-> could not open %s\n", file.c_str());
+			return;
+		}
 		fwrite(bmpfileheader, 1, 14, f);
 		fwrite(bmpinfoheader, 1, 40, f);
-		for (int i = 0; i < h; i++) {
-			fwrite(img + (w * (h - i - 1) * 3), 3, w, f);
-			fwrite(bmppad, 1, (4 - (w * 3) % 4) % 4, f);
-		}
 
-		free(img);
+		// bitmaps are stored bottom row first, rows padded to 4 bytes
+		size_t rowBytes = (size_t)w * 3 + (4 - (w * 3) % 4) % 4;
+		int bandRows = (int)std::max<size_t>(_threads, (8 << 20) / rowBytes);
+		std::vector<unsigned char> band((size_t)std::min(bandRows, h) * rowBytes, 0);
+		for (int start = 0; start < h; start += bandRows) {
+			int end = std::min(h, start + bandRows);
+			parallelFor(start, end, _threads, [&](int first, int last) {
+				for (int k = first; k < last; k++) {
+					colorRow(h - k - 1, band.data() + (size_t)(k - start) * rowBytes);
+				}
+			});
+			fwrite(band.data(), 1, (size_t)(end - start) * rowBytes, f);
+		}
 		fclose(f);
 	}
+
+private:
+	int _threads;
+};
+
+
+// the layers saveTerrainToBitmap draws, copied out of a terrain so they can be drawn and written
+// anywhere (e.g. on an AsyncWriter's thread while the terrain carries on)
+struct BitmapLayers {
+	int seed = 0;
+	int rows = 0;
+	int cols = 0;
+	int threads = 1; // for colouring the rows
+	std::vector<std::vector<SLTerrain::TerrainType>> terrainTypes;
+	std::vector<std::vector<float>> height;
+	std::vector<std::vector<float>> heightFilled;
+	std::vector<std::vector<uint64_t>> flowAccumulation;
+	std::vector<std::vector<float>> erosionDeposition;
+	std::vector<std::vector<float>> slope;
+	std::vector<std::vector<float>> aspect;
 };
 
+// copies the layers as the last year left them (e.g. slope and aspect from before its erosion), only
+// building ones that were never built, so only call from the thread that runs the terrain
+inline BitmapLayers captureBitmapLayers(SLTerrain& terrain) {
+	SLHydrology& hydro = terrain.getHydro();
+	for (auto layer : { SLHydrology::HEIGHT_FILLED, SLHydrology::FLOW_ACCUMULATION, SLHydrology::SLOPE, SLHydrology::ASPECT }) {
+		hydro.ensureLayer(layer);
+	}
+	BitmapLayers layers;
+	layers.seed = terrain.getFBMParams().seed;
+	layers.rows = terrain.getRows();
+	layers.cols = terrain.getCols();
+	layers.threads = terrain.getPipelineParams().threads;
+	layers.terrainTypes = terrain.getTerrainTypes();
+	layers.height = hydro.getHeightMapConst();
+	layers.heightFilled = hydro.getHeightMapFilledConst();
+	layers.flowAccumulation = hydro.getFlowAccumulationConst();
+	layers.erosionDeposition = hydro.getErosionDeposition();
+	layers.slope = hydro.getSlopeConst();
+	layers.aspect = hydro.getAspectConst();
+	return layers;
+}
+
+// saves the main layers of a terrain as bitmaps, including a shaded terrain map
+// filePrefix can hold a directory and/or job name (e.g. "out/job12-")
+inline void saveBitmapLayers(const BitmapLayers& layers, std::string filePrefix = "") {
+	BmpOutput mp(layers.threads); // save terrain to bitmaps
+
+	std::string fileSuffix = "-seed" + std::to_string(layers.seed) + ".bmp";
+	int rows = layers.rows;
+	int cols = layers.cols;
+
+	// terrain types map
+	ColorCategories<SLTerrain::TerrainType> terrainColorCategories;
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::GRASSLAND, SLColor("6aa961"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::FOREST, SLColor("264d42"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::VALLEY, SLColor("337b55"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::MOUNTAIN, SLColor("909294"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::GLACIER, SLColor("eef5ff"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::PLATEAU, SLColor("6f5d53"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::STANDING_WATER, SLColor("3b6dca"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::RIVER, SLColor("2f5eb5"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::IRON, SLColor("b3744e"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::COAL, SLColor("151564"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::STONE, SLColor("989aa5"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::BOG_IRON, SLColor("547d83"));
+	terrainColorCategories.addColorRangeCenter(SLTerrain::TerrainType::URANIUM, SLColor("51ff4f"));
+	mp.saveTerrainAsBitMap(layers.terrainTypes, terrainColorCategories, filePrefix + "terrainTypes" + fileSuffix, CGT_EXACT);
+
+	// height map
+	ColorCategories<float> heightColorCategories;
+	heightColorCategories.addColorRangeCenter(0, SLColor(0));
+	heightColorCategories.addColorRangeCenter(100, SLColor(255));
+	mp.saveTerrainAsBitMap(layers.height, heightColorCategories, filePrefix + "heightmap" + fileSuffix, CGT_GRADATED);
+
+	// height map filled
+	ColorCategories<float> heightFilledColorCategories;
+	heightFilledColorCategories.addColorRangeCenter(0, SLColor(0));
+	heightFilledColorCategories.addColorRangeCenter(100, SLColor(255));
+	mp.saveTerrainAsBitMap(layers.heightFilled, heightFilledColorCategories, filePrefix + "heightmapFilled" + fileSuffix, CGT_GRADATED);
+
+	// flow accumulation map
+	ColorCategories<uint64_t> flowColorCategories;
+	flowColorCategories.addColorRangeCenter(128, SLColor("222034"));
+	flowColorCategories.addColorRangeCenter(32, SLColor("3365ff"));
+	flowColorCategories.addColorRangeCenter(8, SLColor("ffcb55"));
+	flowColorCategories.addColorRangeCenter(4, SLColor("fb802d"));
+	flowColorCategories.addColorRangeCenter(1, SLColor("f9160e"));
+	mp.saveTerrainAsBitMap(layers.flowAccumulation, flowColorCategories, filePrefix + "flow" + fileSuffix, CGT_GRADATED);
+
+	// USPED (erosion and deposition) map
+	ColorCategories<float> uspedColorCategories;
+	uspedColorCategories.addColorRangeCenter(-10000, SLColor(0));
+	uspedColorCategories.addColorRangeCenter(-2000, SLColor("f9160e"));
+	uspedColorCategories.addColorRangeCenter(0, SLColor("ffcb55"));
+	uspedColorCategories.addColorRangeCenter(2000, SLColor("3365ff"));
+	uspedColorCategories.addColorRangeCenter(10000, SLColor(255));
+	mp.saveTerrainAsBitMap(layers.erosionDeposition, uspedColorCategories, filePrefix + "USPED" + fileSuffix, CGT_GRADATED);
+
+	// aspect overlay map --> used here to create shadows and highlights
+	ColorCategories<float> aspectCategories;
+	aspectCategories.addColorRangeCenter(1, SLColor("fff0be", 100));
+	aspectCategories.addColorRangeCenter(0, SLColor("aca39d", 0));
+	aspectCategories.addColorRangeCenter(-0.3, SLColor("3c3939", 90));
+	aspectCategories.addColorRangeCenter(-1, SLColor("141928", 180));
+
+	// add aspect to terraintypes using alpha to get a better visualisation
+	const std::vector<std::vector<float>>& slope = layers.slope;
+	const std::vector<std::vector<float>>& aspect = layers.aspect;
+	auto& terrainTypes = layers.terrainTypes;
+	ColorLut<SLTerrain::TerrainType> terrainLut = terrainColorCategories.compile(CGT_EXACT);
+	ColorLut<float> aspectLut = aspectCategories.compile(CGT_GRADATED);
+	mp.saveRows(cols, rows, filePrefix + "terrain" + fileSuffix, [&](int i, unsigned char* bgr) {
+		for (int j = 0; j < cols; j++) {
+			float opacity = (round(slope[i][j] / 15)) / 2.0;
+			if (opacity > 1) {
+				opacity = 1;
+			}
+
+			if (aspect[i][j] <= -1) { opacity = 0; }
+			else if (aspect[i][j] <= 0 || aspect[i][j] > 315) { opacity *= -0.9; }
+			else if (aspect[i][j] <= 45) { opacity *= 0.8; }
+			else if (aspect[i][j] <= 90) { opacity *= 0.9; }
+			else if (aspect[i][j] <= 135) { opacity *= 1; }
+			else if (aspect[i][j] <= 180) { opacity *= 0.9; }
+			else if (aspect[i][j] <= 225) { opacity *= -0.9; }
+			else if (aspect[i][j] <= 270) { opacity *= -1; }
+			else if (aspect[i][j] <= 315) { opacity *= -1; }
+			else { opacity = 0; }
+
+			SLColor c = terrainLut.color(terrainTypes[i][j]).blendUsingAlpha(aspectLut.color(opacity));
+			ColorLut<float>::colorToBgr(c, bgr + j * 3);
+		}
+	});
+}
+
+inline void saveTerrainToBitmap(SLTerrain& terrain, std::string filePrefix = "") {
+	saveBitmapLayers(captureBitmapLayers(terrain), filePrefix);
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include "../slterrain.h"
+#include "configloader.h"
+
+// all the parameter structs needed for SLTerrain::newMap (plus the processYear pipeline), filled from a config
+// shared by the example and batch programs
+struct TerrainConfig {
+    SLTerrain::FBMParams fbm;
+    SLTerrain::TerrainParams terrain;
+    SLHydrology::ErosionParams erosion;
+    SLTerrain::PipelineParams pipeline;
+    SLTerrain::SaveParams save;
+    int checkpointYears = 0;
+    std::string classifierRules; // rules file for SLTerrain::loadClassifierRules, "default" for the built-in ones
+};
+
+inline TerrainConfig loadTerrainConfig(ConfigLoader& config) {
+    TerrainConfig tc;
+
+    tc.fbm.seed = config["seed"];
+    tc.fbm.octaves = config["octaves"];
+    tc.fbm.offsetX = config["offsetX"];
+    tc.fbm.offsetY = config["offsetY"];
+    tc.fbm.scale = config["scale"];
+    tc.fbm.lacunarity = config["lacunarity"];
+    tc.fbm.H = config["H"];
+    tc.fbm.frequency = config["frequency"];
+    tc.fbm.amplitude = config["amplitude"];
+    tc.fbm.baseHeight = config["baseHeight"];
+    tc.fbm.heightMultiplier = config["heightMultiplier"];
+    tc.fbm.heightModifier = config["heightModifier"];
+    tc.fbm.heightExponent = config["heightExponent"];
+    tc.fbm.normalize = (int)config["normalizeBool"];
+
+    tc.terrain.width = config["width"];
+    tc.terrain.height = config["height"];
+    tc.terrain.age = config["age"];
+    tc.terrain.useChannelErosion = (int)config["channelErosionBool"];
+    tc.terrain.addResources = (int)config["addResourcesBool"];
+    tc.terrain.USPEDminBlur = config["USPEDminBlur"];
+    tc.terrain.USPEDmaxBlur = config["USPEDmaxBlur"];
+    tc.terrain.wildfiresPerYear = config["wildfiresPerYear"];
+    tc.terrain.wildfireIterations = config["wildfireIterations"];
+    tc.terrain.useConvergence = (int)config["convergenceBool"];
+    tc.terrain.convergenceRmsHeight = config["convergenceRmsHeight"];
+    tc.terrain.convergenceD8Fraction = config["convergenceD8Fraction"];
+    tc.terrain.convergenceChannelDrift = config["convergenceChannelDrift"];
+    tc.terrain.convergenceChannelFlow = config["convergenceChannelFlow"];
+    tc.terrain.convergenceWindow = config["convergenceWindow"];
+
+    tc.pipeline.wildfireInterval = config["wildfireInterval"];
+    tc.pipeline.erosionInterval = config["erosionInterval"];
+    tc.pipeline.riversAndLakesInterval = config["riversAndLakesInterval"];
+    tc.pipeline.classifyInterval = config["classifyInterval"];
+    tc.pipeline.overlapRiversAndLakes = (int)config["overlapRiversAndLakesBool"];
+    tc.pipeline.threads = config["threads"];
+    tc.checkpointYears = config["checkpointYears"];
+    tc.save.compress = (int)config["compressSavesBool"];
+    tc.save.floatTolerance = config["saveFloatTolerance"];
+    tc.classifierRules = config.get("classifierRules");
+
+    tc.erosion.cellSize = config["cellSize"];
+    tc.erosion.prevailingRill = (int)config["prevailingRill"];
+    tc.erosion.C = config["C"];
+    tc.erosion.K = config["K"];
+    tc.erosion.R = config["R"];
+    tc.erosion.weightErosion = config["weightErosion"];
+    tc.erosion.converter = config["converter"];
+    tc.erosion.blurFlow = config["preBlurFlowAccumulaionBool"];
+    tc.erosion.strahlerThreshold = config["strahlerThreshold"];
+
+    return tc;
+}
@@ -2,6 +2,7 @@
 #include "utils/slmath.h"
 #include <unordered_set>
 #include <queue>
+#include <sstream>
 
 // init (unneeded if using processAll)
 void SLHydrology::setup() {
@@ -22,6 +23,14 @@ void SLHydrology::setup() {
     _isChannel.resize(0);
     _strahlerOrder.resize(0);
     _erosionDeposition.resize(0);
+    resetLayerStamps();
+}
+
+void SLHydrology::resetLayerStamps() {
+    for (int layer = 0; layer < LAYER_COUNT; layer++) {
+        _stamp[layer] = LayerStamp();
+    }
+    _layerVersion[HEIGHT]++; // anything stamped before the reset is stale
 }
 
 // processes all steps necessary to get flow and erosion
@@ -97,7 +106,7 @@ void SLHydrology::calculateSlope(StdVec2Df& inMatrix, StdVec2Df& outSlope, Angle
 }
 
 // simple direction8 converted to angleType from encoded number
-void SLHydrology::calculateAspect(StdVec2Df& inMatrix, StdVec2Df& outAspect, AngleUnits angleType) {
+void SLHydrology::calculateAspect(StdVec2Df& inMatrix, StdVec2Df& outAspect, AngleUnits angleType, int rngStage) {
     if (inMatrix.size() == 0) {
         printf("::::ERROR:::: calculateAspect-> inMatrix size = 0\n");
         return;
@@ -105,24 +114,31 @@ void SLHydrology::calculateAspect(StdVec2Df& inMatrix, StdVec2Df& outAspect, Ang
     int rows = inMatrix.size();
     int cols = inMatrix[0].size();
     
-    outAspect.assign(rows, std::vector<float>(cols, 0));
-
     StdVec2Di d8tofill(rows, std::vector<int>(cols, -1));
 
     calculateDirection8(inMatrix, d8tofill);
+    aspectFromDirection8(d8tofill, outAspect, angleType, rngStage);
+}
+
+void SLHydrology::aspectFromDirection8(StdVec2Di& d8tofill, StdVec2Df& outAspect, AngleUnits angleType, int rngStage) {
+    int rows = d8tofill.size();
+    int cols = d8tofill[0].size();
+
+    outAspect.assign(rows, std::vector<float>(cols, 0));
+
     for (int i = 0; i < d8tofill.size(); i++) {
         for (int j = 0; j < d8tofill[0].size(); j++) {
             float newAspect = 0;
             if (angleType == AngleUnits::RADIAN) {
                 newAspect = decodeDirectionToRadian(d8tofill[i][j]);
                 if (newAspect == -1) {//sink/flat
-                    newAspect = SLRng::getFloat(0, 2 * 3.14159265359);
+                    newAspect = _rng.getFloat(rngStage, i * cols + j, 0, 2 * 3.14159265359);
                 }
             }
             else {
                 newAspect = decodeDirectionToDegree(d8tofill[i][j]);
                 if (newAspect == -1) {//sink/flat
-                    newAspect = SLRng::getFloat(0, 360);
+                    newAspect = _rng.getFloat(rngStage, i * cols + j, 0, 360);
                 }
             }
             
@@ -248,6 +264,74 @@ void SLHydrology::calculateDirection8(StdVec2Df& inMatrix, StdVec2Di& outD8) {
 
 
 // LOCAL ANALYSIS ON INTERNAL DATA---------------------------------------------------------------------------------------------
+// basic analysis on the stored heightmap, skipped if already built from the current heights
+void SLHydrology::calculateSlope(AngleUnits slopeType) {
+    if (isCurrent(SLOPE, HEIGHT, slopeType) || _z.size() == 0) { return; }
+    calculateSlope(_z, _slope, slopeType);
+    markBuilt(SLOPE, HEIGHT, slopeType);
+}
+
+void SLHydrology::calculateAspect(AngleUnits angleType) {
+    if (isCurrent(ASPECT, HEIGHT, angleType) || _z.size() == 0) { return; }
+    if (isCurrent(FLOW_DIRECTION, HEIGHT, false)) {
+        aspectFromDirection8(_flowDirection, _aspect, angleType, RNG_ASPECT_FLATS); // same D8 as calculateAspect(_z) would make
+    }
+    else {
+        calculateAspect(_z, _aspect, angleType);
+    }
+    markBuilt(ASPECT, HEIGHT, angleType);
+}
+
+void SLHydrology::calculateDirection8(bool useFilled) {
+    Layer input = useFilled ? HEIGHT_FILLED : HEIGHT;
+    auto& heightMap = useFilled ? _zFilled : _z;
+    if (isCurrent(FLOW_DIRECTION, input, useFilled) || heightMap.size() == 0) { return; }
+    calculateDirection8(heightMap, _flowDirection);
+    markBuilt(FLOW_DIRECTION, input, useFilled);
+}
+
+// rebuilds a derived layer (and what it needs) if the heights have changed since it was built,
+// with the same settings it was last built with
+void SLHydrology::updateLayer(Layer layer) {
+    if (_z.size() == 0 || isLayerCurrent(layer)) {
+        return;
+    }
+    LayerStamp& st = _stamp[layer];
+    switch (layer) {
+    case HEIGHT_FILLED:
+        fillSinksWangLiu(st.variant);
+        break;
+    case SLOPE:
+        calculateSlope(st.built ? (AngleUnits)(int)st.variant : DEGREE);
+        break;
+    case ASPECT:
+        calculateAspect(st.built ? (AngleUnits)(int)st.variant : DEGREE);
+        break;
+    case FLOW_DIRECTION:
+        if (st.variant) { updateLayer(HEIGHT_FILLED); }
+        calculateDirection8((bool)st.variant);
+        break;
+    case FLOW_DIRECTION_IN:
+        updateLayer(FLOW_DIRECTION);
+        sumFlowDirectionsIn();
+        break;
+    case FLOW_ACCUMULATION:
+        updateLayer(FLOW_DIRECTION);
+        calculateFlowAccumulation();
+        break;
+    case BLURRED_FLOW_ACCUMULATION:
+        updateLayer(FLOW_ACCUMULATION);
+        blurFlowAccumulation();
+        break;
+    case STRAHLER_ORDER:
+        updateLayer(FLOW_ACCUMULATION);
+        calculateStrahlerOrder();
+        break;
+    default: // heights, and layers that only come from explicit calls
+        break;
+    }
+}
+
 // methods should be called in order 
 // 1. slope + aspect
 // 2. calculateDirection8
@@ -263,14 +347,6 @@ void SLHydrology::calculateFlowAccumulation() {
         printf("::::ERROR:::: calculateFlowAccumulation-> hieghtmap size = 0\n");
         return;
     }
-    else if (_slope.size() == 0) {
-        printf("::::ERROR:::: calculateFlowAccumulation-> slope size = 0 -> calculate slope first\n");
-        return;
-    }
-    else if (_aspect.size() == 0) {
-        printf("::::ERROR:::: calculateFlowAccumulation-> aspect size = 0 -> calculate aspect first\n");
-        return;
-    }
     else if (_flowDirection.size() == 0) {
         printf("::::ERROR:::: calculateFlowAccumulation-> flowDirectionIn size = 0 -> calculate flowDirectionIn first\n");
         return;
@@ -278,7 +354,10 @@ void SLHydrology::calculateFlowAccumulation() {
     int rows = _z.size();
     int cols = _z[0].size();
 
-    sumFlowDirectionsIn();
+    if (!isCurrent(FLOW_DIRECTION_IN, FLOW_DIRECTION, 0)) {
+        sumFlowDirectionsIn();
+    }
+    if (isCurrent(FLOW_ACCUMULATION, FLOW_DIRECTION_IN, 0)) { return; }
 
     _flowAccumulation.assign(rows, std::vector<uint64_t>(cols, 0));
 
@@ -287,6 +366,7 @@ void SLHydrology::calculateFlowAccumulation() {
             flowAccumRecurv(i, j);
         }
     }
+    markBuilt(FLOW_ACCUMULATION, FLOW_DIRECTION_IN, 0);
 }
 
 
@@ -333,6 +413,7 @@ void SLHydrology::blurFlowAccumulation() {
         printf("::::ERROR:::: blurFlowAccumulation-> flowAccumulation size = 0 -> calculate flowAccumulation first\n");
         return;
     }
+    if (isCurrent(BLURRED_FLOW_ACCUMULATION, FLOW_ACCUMULATION, 0)) { return; }
     int rows = _flowAccumulation.size();
     int cols = _flowAccumulation[0].size();
 
@@ -345,6 +426,7 @@ void SLHydrology::blurFlowAccumulation() {
     }
 
     blur(_blurredFlowAccumulation, 2, 1);
+    markBuilt(BLURRED_FLOW_ACCUMULATION, FLOW_ACCUMULATION, 0);
 }
 
 
@@ -375,6 +457,7 @@ void SLHydrology::sumFlowDirectionsIn() {
             }
         }
     }
+    markBuilt(FLOW_DIRECTION_IN, FLOW_DIRECTION, 0);
 }
 
 // fill sinks following Wang and Liu (2006)
@@ -386,6 +469,7 @@ void SLHydrology::fillSinksWangLiu(float minimumHeightDifferent) {
         printf("::::ERROR:::: fillSinksWangLiu-> hieghtmap size = 0\n");
         return;
     }
+    if (isCurrent(HEIGHT_FILLED, HEIGHT, minimumHeightDifferent)) { return; }
     int rows = _z.size();
     int cols = _z[0].size();
 
@@ -441,6 +525,7 @@ void SLHydrology::fillSinksWangLiu(float minimumHeightDifferent) {
         processed[i][j] = CLOSED;
     }
     _zFilled = zSpill;
+    markBuilt(HEIGHT_FILLED, HEIGHT, minimumHeightDifferent);
 }
 
 // simple channel identification using flow-->creates messy-looking channels
@@ -463,6 +548,7 @@ void SLHydrology::identifyChannelsByFlow(float flowAccumulationThresh) {
             }
         }
     }
+    markBuilt(IS_CHANNEL, FLOW_ACCUMULATION, flowAccumulationThresh);
 }
 
 // channel identification by strahler order threshold
@@ -484,6 +570,7 @@ void SLHydrology::identifyChannelsByStrahler(int threshold) {
             }
         }
     }
+    markBuilt(IS_CHANNEL, STRAHLER_ORDER, threshold);
 }
 
 // recursively tracks channels from headwaters to calculate strahler order
@@ -493,18 +580,11 @@ void SLHydrology::calculateStrahlerOrder() {
         printf("::::ERROR:::: USPED-> hieghtmap size = 0\n");
         return;
     }
-    else if (_slope.size() == 0) {
-        printf("::::ERROR:::: USPED-> slope size = 0 -> calculate slope first\n");
-        return;
-    }
-    else if (_aspect.size() == 0) {
-        printf("::::ERROR:::: USPED-> aspect size = 0 -> calculate aspect first\n");
-        return;
-    }
-    if (_flowDirection.size() == 0) {
+    if (_flowDirection.size() == 0 || _flowAccumulation.size() == 0) {
         printf("::::ERROR:::: USPED-> flowAccumulation size = 0 -> calculate flowAccumulation first\n");
         return;
     }
+    if (isCurrent(STRAHLER_ORDER, FLOW_ACCUMULATION, _ero.strahlerThreshold)) { return; }
     int rows = _flowDirection.size();
     int cols = _flowDirection[0].size();
     _strahlerOrder.assign(rows, std::vector<int>(cols, 0));
@@ -518,6 +598,7 @@ void SLHydrology::calculateStrahlerOrder() {
             }
         }
     }
+    markBuilt(STRAHLER_ORDER, FLOW_ACCUMULATION, _ero.strahlerThreshold);
 }
 
 
@@ -619,7 +700,7 @@ void SLHydrology::USPED(float multiplier, StdVec2Df* C, StdVec2Df* K, StdVec2Df*
         prevailingRill = true;
     }
     else {
-        prevailingRill = SLRng::getBool();
+        prevailingRill = _rng.getBool(RNG_USPED_RILL, 0);
     }
 
     _erosionDeposition.assign(rows, std::vector<float>(cols, 0));
@@ -697,7 +778,7 @@ void SLHydrology::USPED(float multiplier, StdVec2Df* C, StdVec2Df* K, StdVec2Df*
 
     // aspect qsx
     StdVec2Df qsxAspect(rows, std::vector<float>(cols, 0));
-    calculateAspect(qsx, qsxAspect, DEGREE);
+    calculateAspect(qsx, qsxAspect, DEGREE, RNG_QSX_ASPECT_FLATS);
 
     // STEP 5
     // slope qsy
@@ -706,7 +787,7 @@ void SLHydrology::USPED(float multiplier, StdVec2Df* C, StdVec2Df* K, StdVec2Df*
 
     // aspect qsy
     StdVec2Df qsyAspect(rows, std::vector<float>(cols, 0));
-    calculateAspect(qsy, qsyAspect, DEGREE);
+    calculateAspect(qsy, qsyAspect, DEGREE, RNG_QSY_ASPECT_FLATS);
 
 
     // STEP 6
@@ -738,6 +819,7 @@ void SLHydrology::USPED(float multiplier, StdVec2Df* C, StdVec2Df* K, StdVec2Df*
             _erosionDeposition[i][j] -= (*R)[i][j] * _ero.weightErosion;
         }
     }
+    markBuilt(EROSION_DEPOSITION, FLOW_ACCUMULATION, multiplier);
 }
 
 
@@ -776,6 +858,7 @@ void SLHydrology::basicFillSinksPinholesMin() {
         }
     }
     _z = newMap;
+    _layerVersion[HEIGHT]++;
 }
 
 void SLHydrology::basicFillSinksPinholesAvg() {
@@ -813,6 +896,7 @@ void SLHydrology::basicFillSinksPinholesAvg() {
         }
     }
     _z = newMap;
+    _layerVersion[HEIGHT]++;
 }
 
 
@@ -839,4 +923,252 @@ void SLHydrology::basicFlattenPeaks() {
         }
     }
     _z = newMap;
-}
\ No newline at end of file
+    _layerVersion[HEIGHT]++;
+}
+
+
+
+//---------------------------------------------------------------------------------------------------
+// save/load of single layers, loaded layers are stamped as built from the current heights
+// (so load HEIGHT first). adoptLayer stamps the same way.
+
+bool SLHydrology::saveLayer(Layer layer, std::ofstream& fout) {
+    switch (layer) {
+    case HEIGHT: return saveMatrix(_z, fout);
+    case HEIGHT_FILLED: return saveMatrix(_zFilled, fout);
+    case SLOPE: return saveMatrix(_slope, fout);
+    case ASPECT: return saveMatrix(_aspect, fout);
+    case FLOW_DIRECTION: return saveMatrix(_flowDirection, fout);
+    case FLOW_DIRECTION_IN: return saveMatrix(_flowDirectionIn, fout);
+    case FLOW_ACCUMULATION: return saveMatrix(_flowAccumulation, fout);
+    case BLURRED_FLOW_ACCUMULATION: return saveMatrix(_blurredFlowAccumulation, fout);
+    case STRAHLER_ORDER: return saveMatrix(_strahlerOrder, fout);
+    case EROSION_DEPOSITION: return saveMatrix(_erosionDeposition, fout);
+    case IS_CHANNEL: { // vector<bool> is packed, so save as bytes
+        std::vector<std::vector<uint8_t>> channels(_isChannel.size());
+        for (int i = 0; i < _isChannel.size(); i++) {
+            channels[i].assign(_isChannel[i].begin(), _isChannel[i].end());
+        }
+        return saveMatrix(channels, fout);
+    }
+    default:
+        printf("::::ERROR:::: saveLayer-> unknown layer %d\n", layer);
+        return false;
+    }
+}
+
+bool SLHydrology::loadLayer(Layer layer, std::ifstream& fin) {
+    bool loaded = false;
+    switch (layer) {
+    case HEIGHT:
+        loaded = loadMatrix(_z, fin);
+        _layerVersion[HEIGHT]++;
+        return loaded;
+    case HEIGHT_FILLED: loaded = loadMatrix(_zFilled, fin); break;
+    case SLOPE: loaded = loadMatrix(_slope, fin); break;
+    case ASPECT: loaded = loadMatrix(_aspect, fin); break;
+    case FLOW_DIRECTION: loaded = loadMatrix(_flowDirection, fin); break;
+    case FLOW_DIRECTION_IN: loaded = loadMatrix(_flowDirectionIn, fin); break;
+    case FLOW_ACCUMULATION: loaded = loadMatrix(_flowAccumulation, fin); break;
+    case BLURRED_FLOW_ACCUMULATION: loaded = loadMatrix(_blurredFlowAccumulation, fin); break;
+    case STRAHLER_ORDER: loaded = loadMatrix(_strahlerOrder, fin); break;
+    case EROSION_DEPOSITION: loaded = loadMatrix(_erosionDeposition, fin); break;
+    case IS_CHANNEL: {
+        std::vector<std::vector<uint8_t>> channels;
+        loaded = loadMatrix(channels, fin);
+        _isChannel.assign(channels.size(), std::vector<bool>());
+        for (int i = 0; i < channels.size(); i++) {
+            _isChannel[i].assign(channels[i].begin(), channels[i].end());
+        }
+        break;
+    }
+    default:
+        printf("::::ERROR:::: loadLayer-> unknown layer %d\n", layer);
+        return false;
+    }
+
+    markExternal(layer, _stamp[layer].variant);
+    return loaded;
+}
+
+const char* SLHydrology::getLayerName(Layer layer) {
+    switch (layer) {
+    case HEIGHT: return "height";
+    case HEIGHT_FILLED: return "heightFilled";
+    case SLOPE: return "slope";
+    case ASPECT: return "aspect";
+    case FLOW_DIRECTION: return "flowDirection";
+    case FLOW_DIRECTION_IN: return "flowDirectionIn";
+    case FLOW_ACCUMULATION: return "flowAccumulation";
+    case BLURRED_FLOW_ACCUMULATION: return "blurredFlowAccumulation";
+    case STRAHLER_ORDER: return "strahlerOrder";
+    case IS_CHANNEL: return "isChannel";
+    case EROSION_DEPOSITION: return "erosionDeposition";
+    default: return "unknown";
+    }
+}
+
+bool SLHydrology::saveLayer(Layer layer, SLContainerWriter& out, const std::string& prefix) {
+    std::string name = prefix + getLayerName(layer);
+    switch (layer) {
+    case HEIGHT: return out.writeGrid(name, _z);
+    case HEIGHT_FILLED: return out.writeGrid(name, _zFilled);
+    case SLOPE: return out.writeGrid(name, _slope);
+    case ASPECT: return out.writeGrid(name, _aspect);
+    case FLOW_DIRECTION: return out.writeGrid(name, _flowDirection);
+    case FLOW_DIRECTION_IN: return out.writeGrid(name, _flowDirectionIn);
+    case FLOW_ACCUMULATION: return out.writeGrid(name, _flowAccumulation);
+    case BLURRED_FLOW_ACCUMULATION: return out.writeGrid(name, _blurredFlowAccumulation);
+    case STRAHLER_ORDER: return out.writeGrid(name, _strahlerOrder);
+    case EROSION_DEPOSITION: return out.writeGrid(name, _erosionDeposition);
+    case IS_CHANNEL: { // vector<bool> is packed, so save as bytes
+        std::vector<std::vector<uint8_t>> channels(_isChannel.size());
+        for (int i = 0; i < _isChannel.size(); i++) {
+            channels[i].assign(_isChannel[i].begin(), _isChannel[i].end());
+        }
+        return out.writeGrid(name, channels);
+    }
+    default:
+        printf("::::ERROR:::: saveLayer-> unknown layer %d\n", layer);
+        return false;
+    }
+}
+
+bool SLHydrology::loadLayer(Layer layer, SLContainerReader& in, const std::string& prefix, SLContainer::Rect rect) {
+    std::string name = prefix + getLayerName(layer);
+    bool loaded = false;
+    switch (layer) {
+    case HEIGHT:
+        loaded = in.readGrid(name, _z, rect);
+        _layerVersion[HEIGHT]++;
+        return loaded;
+    case HEIGHT_FILLED: loaded = in.readGrid(name, _zFilled, rect); break;
+    case SLOPE: loaded = in.readGrid(name, _slope, rect); break;
+    case ASPECT: loaded = in.readGrid(name, _aspect, rect); break;
+    case FLOW_DIRECTION: loaded = in.readGrid(name, _flowDirection, rect); break;
+    case FLOW_DIRECTION_IN: loaded = in.readGrid(name, _flowDirectionIn, rect); break;
+    case FLOW_ACCUMULATION: loaded = in.readGrid(name, _flowAccumulation, rect); break;
+    case BLURRED_FLOW_ACCUMULATION: loaded = in.readGrid(name, _blurredFlowAccumulation, rect); break;
+    case STRAHLER_ORDER: loaded = in.readGrid(name, _strahlerOrder, rect); break;
+    case EROSION_DEPOSITION: loaded = in.readGrid(name, _erosionDeposition, rect); break;
+    case IS_CHANNEL: {
+        std::vector<std::vector<uint8_t>> channels;
+        loaded = in.readGrid(name, channels, rect);
+        _isChannel.assign(channels.size(), std::vector<bool>());
+        for (int i = 0; i < channels.size(); i++) {
+            _isChannel[i].assign(channels[i].begin(), channels[i].end());
+        }
+        break;
+    }
+    default:
+        printf("::::ERROR:::: loadLayer-> unknown layer %d\n", layer);
+        return false;
+    }
+
+    if (loaded) {
+        markExternal(layer, _stamp[layer].variant);
+    }
+    return loaded;
+}
+
+// unlike the single layers, the stamps are restored too so the same layers rebuild after a load
+bool SLHydrology::saveState(SLContainerWriter& out, const std::string& prefix) {
+    std::ostringstream state;
+    saveValue(_ero, state);
+    saveValue(_rng, state);
+    saveValue(_stamp, state);
+    saveValue(_layerVersion, state);
+    bool ok = out.writeBlob(prefix + "hydrologyState", state.str());
+    for (int layer = 0; layer < LAYER_COUNT; layer++) {
+        ok = ok && saveLayer((Layer)layer, out, prefix);
+    }
+    return ok;
+}
+
+bool SLHydrology::loadState(SLContainerReader& in, const std::string& prefix) {
+    for (int layer = 0; layer < LAYER_COUNT; layer++) {
+        if (!loadLayer((Layer)layer, in, prefix)) {
+            return false;
+        }
+    }
+    std::string bytes;
+    if (!in.readBlob(prefix + "hydrologyState", bytes)) {
+        return false;
+    }
+    std::istringstream state(bytes);
+    loadValue(_ero, state);
+    loadValue(_rng, state);
+    loadValue(_stamp, state);
+    return loadValue(_layerVersion, state);
+}
+
+// swaps the layer in, so from is left with this object's old data. refused (and nothing swapped)
+// unless the layer has this map's size
+bool SLHydrology::adoptLayer(Layer layer, SLHydrology& from) {
+    auto take = [&](auto& mine, auto& theirs) {
+        if (theirs.size() != _z.size() || (!_z.empty() && theirs[0].size() != _z[0].size())) {
+            printf("::::ERROR:::: adoptLayer-> layer %d doesn't match the map size\n", layer);
+            return false;
+        }
+        std::swap(mine, theirs);
+        return true;
+    };
+    bool ok = false;
+    switch (layer) {
+    case HEIGHT_FILLED: ok = take(_zFilled, from._zFilled); break;
+    case SLOPE: ok = take(_slope, from._slope); break;
+    case ASPECT: ok = take(_aspect, from._aspect); break;
+    case FLOW_DIRECTION: ok = take(_flowDirection, from._flowDirection); break;
+    case FLOW_DIRECTION_IN: ok = take(_flowDirectionIn, from._flowDirectionIn); break;
+    case FLOW_ACCUMULATION: ok = take(_flowAccumulation, from._flowAccumulation); break;
+    case BLURRED_FLOW_ACCUMULATION: ok = take(_blurredFlowAccumulation, from._blurredFlowAccumulation); break;
+    case STRAHLER_ORDER: ok = take(_strahlerOrder, from._strahlerOrder); break;
+    case IS_CHANNEL: ok = take(_isChannel, from._isChannel); break;
+    case EROSION_DEPOSITION: ok = take(_erosionDeposition, from._erosionDeposition); break;
+    default:
+        printf("::::ERROR:::: adoptLayer-> can't adopt layer %d\n", layer);
+        return false;
+    }
+    if (!ok) {
+        return false;
+    }
+    markExternal(layer, from._stamp[layer].variant);
+    return true;
+}
+
+void SLHydrology::copyState(const SLHydrology& from) {
+    _ero = from._ero;
+    _rng = from._rng;
+    std::copy(std::begin(from._stamp), std::end(from._stamp), _stamp);
+    std::copy(std::begin(from._layerVersion), std::end(from._layerVersion), _layerVersion);
+}
+
+void SLHydrology::copyLayer(Layer layer, const SLHydrology& from) {
+    switch (layer) {
+    case HEIGHT: _z = from._z; break;
+    case HEIGHT_FILLED: _zFilled = from._zFilled; break;
+    case SLOPE: _slope = from._slope; break;
+    case ASPECT: _aspect = from._aspect; break;
+    case FLOW_DIRECTION: _flowDirection = from._flowDirection; break;
+    case FLOW_DIRECTION_IN: _flowDirectionIn = from._flowDirectionIn; break;
+    case FLOW_ACCUMULATION: _flowAccumulation = from._flowAccumulation; break;
+    case BLURRED_FLOW_ACCUMULATION: _blurredFlowAccumulation = from._blurredFlowAccumulation; break;
+    case STRAHLER_ORDER: _strahlerOrder = from._strahlerOrder; break;
+    case IS_CHANNEL: _isChannel = from._isChannel; break;
+    case EROSION_DEPOSITION: _erosionDeposition = from._erosionDeposition; break;
+    default:
+        printf("::::ERROR:::: copyLayer-> unknown layer %d\n", layer);
+        break;
+    }
+}
+
+// loaded/adopted layers are current for the getters, but the unknown input version
+// means explicit calls still rebuild
+void SLHydrology::markExternal(Layer layer, float variant) {
+    LayerStamp& st = _stamp[layer];
+    st.built = true;
+    st.heightVersion = _layerVersion[HEIGHT];
+    st.inputVersion = UINT64_MAX;
+    st.variant = variant;
+    _layerVersion[layer]++;
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "utils/slmath.h"
+#include "utils/slcontainer.h"
 #include <unordered_map>
 
 using namespace SLMath;
@@ -25,6 +26,14 @@ typedef std::vector<std::vector<int>> StdVec2Di;
 // Modification methods (fill sinks, create lakes, adjust heights via USPED) modify the heightmap.
 // Revert to the original heightmap with the revert() method.
 // 
+// Stored layers are dirty-tracked: each one records the heights (and input layer) it was built from.
+// Calculate calls whose inputs haven't changed are skipped, and the getters for derived layers
+// (slope, aspect, D8, flow, strahler...) rebuild them if the heights have changed since.
+// Writing through getHeightMap() marks the heights as changed, so read with getHeightMapConst().
+// The getters rebuild from the current inputs: blurred flow, for example, re-blurs whichever flow
+// accumulation is stored (filled D8 after processYear's rivers stage). Use the Const getters to read
+// a layer as the pipeline left it, e.g. slope from before this year's erosion.
+// 
 // -->all matrices are [y][x] for consistency with i, j notation (i.e i = y and x = j)
 // [0][0] is top left for consistency with image formats, like bmp, and opengl (line by line, top down)
 class SLHydrology {
@@ -42,6 +51,30 @@ public:
 	};
 	enum AngleUnits { PERCENT, DEGREE, RADIAN };
 
+	// stored layers, for dirty tracking and for saving/loading layers by name
+	enum Layer {
+		HEIGHT,
+		HEIGHT_FILLED,
+		SLOPE,
+		ASPECT,
+		FLOW_DIRECTION,
+		FLOW_DIRECTION_IN,
+		FLOW_ACCUMULATION,
+		BLURRED_FLOW_ACCUMULATION,
+		STRAHLER_ORDER,
+		IS_CHANNEL,
+		EROSION_DEPOSITION,
+		LAYER_COUNT
+	};
+
+	// stages for the counter-based rng, one per kind of draw
+	enum RngStage {
+		RNG_ASPECT_FLATS = 1,
+		RNG_QSX_ASPECT_FLATS,
+		RNG_QSY_ASPECT_FLATS,
+		RNG_USPED_RILL
+	};
+
 	SLHydrology() {};
 	SLHydrology(StdVec2Df& heightmap, ErosionParams erosionParams = ErosionParams())
 		: _z(heightmap), _ero(erosionParams) {};
@@ -57,33 +90,27 @@ public:
 	// basic heightmap analysis
 	void calculateDirection8(StdVec2Df& inHeightMap, StdVec2Di& outD8);
 	void calculateSlope(StdVec2Df& inHeightMap, StdVec2Df& outSlope, AngleUnits slopeType = DEGREE);
-	void calculateAspect(StdVec2Df& inHeightMap, StdVec2Df& outAspect, AngleUnits angleType = DEGREE);
+	void calculateAspect(StdVec2Df& inHeightMap, StdVec2Df& outAspect, AngleUnits angleType = DEGREE, int rngStage = RNG_ASPECT_FLATS);
 	void calculateAspectAveraged(StdVec2Df& inMatrix, StdVec2Df& outAspect, SLHydrology::AngleUnits angleType);
 
 
 	// LOCAL ANALYSIS OF PROVIDED HEIGHTMAP--------------------------------------------------------------
-	// NOTE-->ORDER of analysis matters!
+	// NOTE-->ORDER of analysis matters for explicit calls (the getters rebuild missing inputs themselves)
 	// 1. slope + aspect
 	// 2. calculateDirection8
 	// 3. calculateFlowAccumulation
 	// 4. calculateStrahlerOrder
 	// 5. indentify channels +/or USPED (erosion and deposition)
+	// each is skipped if the layer is already built from the current inputs with the same settings
 
 	// flow accumulation on stored heightmap
 	void calculateFlowAccumulation();
 	void blurFlowAccumulation();//WHY WHEN CAN JUST BLUR MANUALLY???
 
 	// basic analysis on stored heightmap
-	void calculateSlope(AngleUnits slopeType = DEGREE) {
-		calculateSlope(_z, _slope, slopeType);
-	}
-	void calculateAspect(AngleUnits angleType = DEGREE) {
-		calculateAspect(_z, _aspect, angleType);
-	}
-	void calculateDirection8(bool useFilled = false) {
-		auto& heightMap = useFilled ? _zFilled : _z;
-		calculateDirection8(heightMap, _flowDirection);
-	}
+	void calculateSlope(AngleUnits slopeType = DEGREE);
+	void calculateAspect(AngleUnits angleType = DEGREE); // reuses D8 if already calculated on the unfilled heights
+	void calculateDirection8(bool useFilled = false);
 
 	// fill sinks and create lakes
 	void fillSinksWangLiu(float minimumHeightDifferent);//TODO--generalize?
@@ -108,24 +135,67 @@ public:
 
 	//setters
 	void setErosionParams(ErosionParams ero) { _ero = ero; }
+	void setRng(SLCounterRng rng) { _rng = rng; } // keyed by seed and year, see SLCounterRng
+
+	// save/load a single stored layer (loaded layers count as built from the current heights)
+	// in a container the layer is the entry prefix + getLayerName(layer). a rect loads just that
+	// part of the layer (see SLContainerReader::readGrid), so every layer should use the same one
+	static const char* getLayerName(Layer layer);
+	bool saveLayer(Layer layer, SLContainerWriter& out, const std::string& prefix = "");
+	bool loadLayer(Layer layer, SLContainerReader& in, const std::string& prefix = "", SLContainer::Rect rect = SLContainer::Rect());
+	bool saveLayer(Layer layer, std::ofstream& fout); // raw, for the old save format
+	bool loadLayer(Layer layer, std::ifstream& fin);
+	// takes over a layer built by another SLHydrology (e.g. a background analysis of a height snapshot),
+	// false if it isn't this map's size
+	bool adoptLayer(Layer layer, SLHydrology& from);
+	// a copy of another SLHydrology a piece at a time (e.g. spread over frames): copyState takes the
+	// params, rng and layer stamps, copyLayer one layer's data
+	void copyState(const SLHydrology& from);
+	void copyLayer(Layer layer, const SLHydrology& from);
+	// everything needed to carry on exactly where this left off (params, rng, all layers and their stamps)
+	bool saveState(SLContainerWriter& out, const std::string& prefix = "");
+	bool loadState(SLContainerReader& in, const std::string& prefix = "");
+	void updateLayer(Layer layer); // rebuild if heights have changed since built (called by the getters)
+	bool isLayerCurrent(Layer layer) { return _stamp[layer].built && _stamp[layer].heightVersion == _layerVersion[HEIGHT]; }
+	// builds a layer that has never been built, but leaves a stale one as it is
+	void ensureLayer(Layer layer) { if (!_stamp[layer].built) { updateLayer(layer); } }
 
 	//getters
 	int getCols() { return _z[0].size(); }
 	int getRows() { return _z.size(); }
 	ErosionParams getErosionParams() { return _ero; }
-
-	StdVec2Df& getHeightMap() { return _z; }
-	StdVec2Df& getHeightMapFilled() { return _zFilled; }
-	std::vector<std::vector<uint64_t>>& getFlowAccumulation() { return _flowAccumulation; }
-	StdVec2Df& getBlurredFlowAccumulation() { return _blurredFlowAccumulation; }
-	StdVec2Di& getFlowDirection() { return _flowDirection; }
-	StdVec2Di& getFlowDirectionIn() { return _flowDirectionIn; }
-	StdVec2Df& getSlope() { return _slope; }
-	StdVec2Df& getAspect() { return _aspect; }
+	SLCounterRng getRng() { return _rng; }
+
+	// for writing: marks all derived layers as stale. The mark is made when it's called, so it also
+	// counts for a read, and writes through a reference kept while a layer gets rebuilt aren't seen
+	// (call markHeightsChanged() after those)
+	StdVec2Df& getHeightMap() { _layerVersion[HEIGHT]++; return _z; }
+	void markHeightsChanged() { _layerVersion[HEIGHT]++; }
+	const StdVec2Df& getHeightMapConst() { return _z; }
+
+	// derived layers are rebuilt first if the heights have changed (treat as read-only)
+	StdVec2Df& getHeightMapFilled() { updateLayer(HEIGHT_FILLED); return _zFilled; }
+	std::vector<std::vector<uint64_t>>& getFlowAccumulation() { updateLayer(FLOW_ACCUMULATION); return _flowAccumulation; }
+	StdVec2Df& getBlurredFlowAccumulation() { updateLayer(BLURRED_FLOW_ACCUMULATION); return _blurredFlowAccumulation; }
+	StdVec2Di& getFlowDirection() { updateLayer(FLOW_DIRECTION); return _flowDirection; }
+	StdVec2Di& getFlowDirectionIn() { updateLayer(FLOW_DIRECTION_IN); return _flowDirectionIn; }
+	StdVec2Df& getSlope() { updateLayer(SLOPE); return _slope; }
+	StdVec2Df& getAspect() { updateLayer(ASPECT); return _aspect; }
+	StdVec2Di& getStrahlerOrder() { updateLayer(STRAHLER_ORDER); return _strahlerOrder; }
+
+	// set by explicit calls only (depend on thresholds and C/K/R factors)
 	std::vector<std::vector<bool>>& getIsChannel() { return _isChannel; }
-	StdVec2Di& getStrahlerOrder() { return _strahlerOrder; }
 	StdVec2Df& getErosionDeposition() { return _erosionDeposition; }
 
+	// layers as they are stored, without rebuilding (may be stale, see isLayerCurrent)
+	const StdVec2Df& getHeightMapFilledConst() const { return _zFilled; }
+	const StdVec2Df& getSlopeConst() const { return _slope; }
+	const StdVec2Df& getAspectConst() const { return _aspect; }
+	const StdVec2Di& getFlowDirectionConst() const { return _flowDirection; }
+	const std::vector<std::vector<uint64_t>>& getFlowAccumulationConst() const { return _flowAccumulation; }
+	const std::vector<std::vector<bool>>& getIsChannelConst() const { return _isChannel; }
+	const StdVec2Df& getBlurredFlowAccumulationConst() const { return _blurredFlowAccumulation; }
+
 
 private:
 	// used by the flow accumulation algorithm, storing all
@@ -135,9 +205,34 @@ private:
 	// recursive internals
 	int flowAccumRecurv(int i, int j); //recursive flow accumulation
 	int strahlerStep(int i, int j, int flowAccumulationThreshold); //recursive strahler order calculation
+
+	// aspect from an already calculated D8 matrix
+	void aspectFromDirection8(StdVec2Di& d8, StdVec2Df& outAspect, AngleUnits angleType, int rngStage);
+
+	// dirty tracking, each layer records what it was built from
+	struct LayerStamp {
+		bool built = false;
+		uint64_t heightVersion = 0; // _layerVersion[HEIGHT] when built
+		uint64_t inputVersion = 0; // _layerVersion of the direct input layer when built
+		float variant = 0; // settings it was built with (units, useFilled, fill minimum...)
+	};
+	LayerStamp _stamp[LAYER_COUNT];
+	uint64_t _layerVersion[LAYER_COUNT] = {}; // bumped every time a layer changes
+	bool isCurrent(Layer layer, Layer input, float variant) {
+		LayerStamp& st = _stamp[layer];
+		return st.built && st.heightVersion == _layerVersion[HEIGHT]
+			&& st.inputVersion == _layerVersion[input] && st.variant == variant;
+	}
+	void markBuilt(Layer layer, Layer input, float variant) {
+		_stamp[layer] = { true, _layerVersion[HEIGHT], _layerVersion[input], variant };
+		_layerVersion[layer]++;
+	}
+	void resetLayerStamps();
+	void markExternal(Layer layer, float variant);
 	
 
 	ErosionParams _ero;
+	SLCounterRng _rng; // for random aspect of flats and alternating rills
 	
 	// terrain data matricies
 	StdVec2Df _z;
@@ -1,6 +1,10 @@
 #include "slTerrain.h"
 #include <unordered_set>
 #include <queue>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+#include <filesystem>
 
 // for initialization (not required if using the newMap function)
 void SLTerrain::setup() {
@@ -8,12 +12,18 @@ void SLTerrain::setup() {
     int cols = getCols();
 
     _terrainType.assign(rows, std::vector<TerrainType>(cols, GRASSLAND));
-    _burned.assign(rows, std::vector<int>(cols, false));
+    _burned.clear();
     _Cfactor.assign(rows, std::vector<float>(cols, _hydro.getErosionParams().C));
+    for (int r = IRON; r <= URANIUM; r++) {
+        depositList((TerrainType)r).clear();
+    }
+    rebuildDepositIndex();
 }
 
 // for map generation using FBM and USPED erosion model
 void SLTerrain::newMap(FBMParams fbmParams, TerrainParams terrainParams, SLHydrology::ErosionParams erosionParams) {
+    dropPendingWork();
+    _genStart = std::chrono::steady_clock::now();
     _fbm = fbmParams;
     _ter = terrainParams;
 
@@ -21,27 +31,33 @@ void SLTerrain::newMap(FBMParams fbmParams, TerrainParams terrainParams, SLHydro
     int cols = terrainParams.width;
 
     if (fbmParams.seed == 0) {
-        _fbm.seed = SLRng::getInt(0, 100000);
+        std::random_device randomSeed; // local so concurrent generators don't share rng state
+        _fbm.seed = randomSeed() % 100001;
         printf("Generation seed: %d\n", _fbm.seed);
 	}
-    SLRng::init(_fbm.seed);
+    _rng = SLCounterRng(_fbm.seed);
+    _year = 0;
+    _riversYear = -1;
+    _classifyYear = -1;
+    _classifyPending = false;
 
 
     auto fbmZ = FBMGenerator(_fbm, rows, cols);
     _hydro = SLHydrology(fbmZ, erosionParams);
+    _hydro.setRng(_rng);
     
     setup();
 
     // extra large gradations across the map to enouragge flow and prevent massive lakes
     auto& z = _hydro.getHeightMap();
-    PerlinNoise2D pNoise;
+    PerlinNoise2D pNoise(SLCounterRng::combine(_fbm.seed, 1));
     int offsetX = _fbm.offsetX;
     int offsetY = _fbm.offsetY;
     if (offsetX == 0) {
-        offsetX = SLRng::getInt(0, 100000);
+        offsetX = _rng.getInt(RNG_OFFSETS, 2, 0, 100000);
     }
     if (offsetY == 0)
-        offsetY = SLRng::getInt(0, 100000); {
+        offsetY = _rng.getInt(RNG_OFFSETS, 3, 0, 100000); {
     }
     float scale = 1000;
     for (int i = 0; i < rows; i++) {
@@ -54,72 +70,381 @@ void SLTerrain::newMap(FBMParams fbmParams, TerrainParams terrainParams, SLHydro
 
     // initial fast generation, skipping channels and terraintype categorization
     if (_ter.age < 10) { _ter.age = 10; }
-    for (int i = 0; i < _ter.age / 5; i++) {
-        _hydro.calculateSlope(SLHydrology::DEGREE); //UPSED uses DEGREE
-        _hydro.calculateDirection8();
-        _hydro.calculateAspect(SLHydrology::DEGREE);
-        printf("Slope and direction calculated\n");
+    _erosionIterationsUsed = 0;
+    _convergedIterations = 0;
+    _prevFlowDirection.clear();
+    _genPhase = GEN_EROSION;
+    _genIteration = 0;
+    _lastCheckpointYear = -1;
+
+    runGeneration();
+}
 
-        _hydro.calculateFlowAccumulation();
-        printf("Flow accumulation calculated\n");
+SLTerrain::GenerationHandle SLTerrain::newMapAsync(FBMParams fbmParams, TerrainParams terrainParams, SLHydrology::ErosionParams erosionParams) {
+    GenerationHandle handle;
+    handle.cancelFlag = std::make_shared<std::atomic<bool>>(false);
+
+    // settings only, the worker builds its own map
+    PipelineParams pipeline = _pipeline;
+    std::vector<ClassifierRule> classifierRules = _classifierRules;
+    std::string checkpointPath = _checkpointPath;
+    int checkpointEvery = _checkpointEvery;
+    ProgressCallback callback = _progressCallback;
+    std::shared_ptr<std::atomic<bool>> cancelFlag = handle.cancelFlag;
+
+    handle.result = std::async(std::launch::async, [=]() {
+        auto terrain = std::make_shared<SLTerrain>();
+        terrain->setPipelineParams(pipeline);
+        terrain->setClassifierRules(classifierRules);
+        terrain->setCheckpointing(checkpointPath, checkpointEvery);
+        terrain->setProgressCallback(callback);
+        terrain->setCancelFlag(cancelFlag);
+        terrain->newMap(fbmParams, terrainParams, erosionParams);
+        return terrain->isCancelled() ? std::shared_ptr<SLTerrain>() : terrain;
+    }).share();
+    return handle;
+}
 
-        _hydro.USPED(5); //multiply erosion/deposition by 5 for faster initial generation at cost of more noise artifacts
-        blurAndOffsetUSPEDErosion();
-        adjustHeightsViaErosionDeposition();
-        printf("USPED erosion and deposition calculated\n");
+void SLTerrain::reportProgress(GenerationStage stage, int iteration, int total) {
+    static const char* names[] = { "erosion", "channels", "years", "done" };
+    GenerationProgress progress;
+    progress.stage = stage;
+    progress.stageName = names[stage];
+    progress.iteration = iteration;
+    progress.total = total;
+    progress.elapsedSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _genStart).count();
+
+    if (_progressCallback) {
+        _progressCallback(progress);
     }
-    _hydro.calculateStrahlerOrder();
-    _hydro.identifyChannelsByStrahler(3);
+    else {
+        printf("-->Generation %s %d/%d (%.2fs)\n", progress.stageName, iteration, total, progress.elapsedSeconds);
+    }
+}
 
-    for (int i = 0; i < 20; i++) {
-        processYear(i);
-        calculateTerrainTypes();
-	}
+// runs the rest of newMap from wherever _genPhase/_genIteration say it is, one year at a time,
+// so generation can be checkpointed between years and resumed
+void SLTerrain::runGeneration() {
+    while (_genPhase != GEN_DONE) {
+        if (isCancelled()) {
+            printf("-->Generation CANCELLED at year %d\n", _year);
+            return;
+        }
+        switch (_genPhase) {
+        case GEN_EROSION:
+            if (_genIteration >= _ter.age / 5) {
+                _genPhase = GEN_CHANNELS;
+                break;
+            }
+            advanceYear();
+            _hydro.calculateSlope(SLHydrology::DEGREE); //UPSED uses DEGREE
+            _hydro.calculateDirection8();
+            _hydro.calculateAspect(SLHydrology::DEGREE);
+            printf("Slope and direction calculated\n");
+            if (isCancelled()) { continue; }
+
+            _hydro.calculateFlowAccumulation();
+            printf("Flow accumulation calculated\n");
+            if (isCancelled()) { continue; }
+
+            _hydro.USPED(5); //multiply erosion/deposition by 5 for faster initial generation at cost of more noise artifacts
+            blurAndOffsetUSPEDErosion();
+            adjustHeightsViaErosionDeposition();
+            printf("USPED erosion and deposition calculated\n");
+
+            _erosionIterationsUsed++;
+            _genIteration++;
+            if (_ter.useConvergence && updateConvergence()) {
+                printf("Erosion converged after %d of %d iterations\n", _erosionIterationsUsed, _ter.age / 5);
+                _genPhase = GEN_CHANNELS;
+            }
+            reportProgress(STAGE_EROSION, _genIteration, _ter.age / 5);
+            break;
+
+        case GEN_CHANNELS:
+            _hydro.calculateStrahlerOrder();
+            _hydro.identifyChannelsByStrahler(3);
+            _genPhase = GEN_YEARS;
+            _genIteration = 0;
+            reportProgress(STAGE_CHANNELS, 1, 1);
+            break;
+
+        case GEN_YEARS:
+            if (_genIteration >= 20) {
+                refreshStaleStages(); // last year may have skipped rivers/lakes or classification
+
+                // uses terrain types to add resources
+                if (_ter.addResources) {
+                    addRndResouceDeposits();
+                }
+                if (_pipeline.publishSnapshots) { publishSnapshot(); }
+                _genPhase = GEN_DONE;
+                reportProgress(STAGE_DONE, 1, 1);
+                break;
+            }
+            processYear(_genIteration);
+            if (isCancelled()) { continue; } // year left unfinished
+            _genIteration++;
+            reportProgress(STAGE_YEARS, _genIteration, 20);
+            break;
+
+        default:
+            _genPhase = GEN_DONE;
+            break;
+        }
 
-    // uses terrain types to add resources
-    if (_ter.addResources) {
-		addRndResouceDeposits();
-	}
+        if (_checkpointEvery > 0 && _year % _checkpointEvery == 0 && _year != _lastCheckpointYear && !isCancelled()) {
+            saveCheckpoint(_checkpointPath);
+        }
+    }
+}
+
+// moves the rng on to the next year's streams (shared with _hydro for aspect flats and rills)
+void SLTerrain::advanceYear() {
+    _year++;
+    _wildfireCount = 0;
+    _rng.setYear(_year);
+    _hydro.setRng(_rng);
+}
+
+// measures how much the last erosion iteration changed the landscape (RMS height change is
+// recorded by adjustHeightsViaErosionDeposition). Returns true once all metrics have stayed
+// under their thresholds for convergenceWindow iterations in a row.
+bool SLTerrain::updateConvergence() {
+    int rows = getRows();
+    int cols = getCols();
+    auto& flowDirection = _hydro.getFlowDirection();
+    auto& flowAccumulation = _hydro.getFlowAccumulation();
+
+    int d8Changes = 0;
+    int channelCells = 0;
+    bool hasPrevious = _prevFlowDirection.size() == rows;
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            if (hasPrevious && _prevFlowDirection[i][j] != flowDirection[i][j]) { d8Changes++; }
+            if (flowAccumulation[i][j] > _ter.convergenceChannelFlow) { channelCells++; }
+        }
+    }
+    _metrics.d8Changes = d8Changes;
+    // relative to at least one cell, so a map without channels (0 -> 0) counts as settled
+    _metrics.channelDrift = std::abs(channelCells - _metrics.channelCells) / (float)std::max(1, _metrics.channelCells);
+    _metrics.channelCells = channelCells;
+    _prevFlowDirection = flowDirection;
+
+    if (!hasPrevious) { return false; }
+
+    bool converged = _metrics.rmsHeightChange < _ter.convergenceRmsHeight
+        && d8Changes < _ter.convergenceD8Fraction * rows * cols
+        && _metrics.channelDrift < _ter.convergenceChannelDrift;
+    _convergedIterations = converged ? _convergedIterations + 1 : 0;
+    return _convergedIterations >= _ter.convergenceWindow;
 }
 
 // terrain generation iteration, a "year" (or say, a turn in a game)
+// each stage only runs when due according to the PipelineParams intervals
 void SLTerrain::processYear(int year) {
+    advanceYear();
+    _stepStage = STEP_WILDFIRE;
+    _stepRow = 0;
+    while (!stepUnit()) {
+        if (isCancelled()) { return; }
+    }
+    if (_pipeline.publishSnapshots) { publishSnapshot(); }
+}
+
+// starts a year on a working copy, so the getters keep returning last year until step() commits it.
+// Only the small state is copied here: the map sized layers are moved aside while the copy is made,
+// and step() copies them over one per unit (see copyUnit), so the copy is spread over the budget too
+void SLTerrain::beginYear() {
+    if (_working) { return; }
+    SLHydrology hydro = std::move(_hydro);
+    StdVec2Di prevFlowDirection = std::move(_prevFlowDirection);
+    std::vector<std::vector<TerrainType>> terrainType = std::move(_terrainType);
+    StdVec2Df cFactor = std::move(_Cfactor);
+    _hydro = SLHydrology();
+    _prevFlowDirection.clear();
+    _terrainType.clear();
+    _Cfactor.clear();
+    _working = std::make_shared<SLTerrain>(*this);
+    _hydro = std::move(hydro);
+    _prevFlowDirection = std::move(prevFlowDirection);
+    _terrainType = std::move(terrainType);
+    _Cfactor = std::move(cFactor);
+
+    _working->_hydro.copyState(_hydro);
+    _working->advanceYear();
+    _working->_stepStage = STEP_WILDFIRE;
+    _working->_stepRow = 0;
+    _copyUnit = 0;
+}
+
+// one map sized layer of the working copy: the hydrology layers, then the terrain's own
+void SLTerrain::copyUnit(int unit) {
+    if (unit < SLHydrology::LAYER_COUNT) {
+        _working->_hydro.copyLayer((SLHydrology::Layer)unit, _hydro);
+        return;
+    }
+    switch (unit - SLHydrology::LAYER_COUNT) {
+    case 0: _working->_terrainType = _terrainType; break;
+    case 1: _working->_Cfactor = _Cfactor; break;
+    case 2: _working->_prevFlowDirection = _prevFlowDirection; break;
+    }
+}
+
+// runs units of the year until the budget is spent, returns true once the year is committed
+// (checked between units, so a long unit like a depression fill can overrun the budget)
+bool SLTerrain::step(int64_t budgetMicroseconds) {
+    auto start = std::chrono::steady_clock::now();
+    if (!_working) { beginYear(); }
+    while (true) {
+        if (_copyUnit < COPY_UNITS) {
+            copyUnit(_copyUnit++);
+        }
+        else if (_working->stepUnit()) {
+            std::shared_ptr<SLTerrain> done = _working;
+            _working.reset();
+            *this = std::move(*done);
+            if (_pipeline.publishSnapshots) { publishSnapshot(); }
+            return true;
+        }
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start);
+        if (elapsed.count() >= budgetMicroseconds) {
+            return false;
+        }
+    }
+}
+
+// copies the layers into a snapshot and swaps it in for readers. The snapshot from two
+// publishes ago is refilled in place if no reader still holds it, so a steady simulation
+// doesn't allocate (the previous one may still be in use by readers)
+void SLTerrain::publishSnapshot() {
+    std::shared_ptr<TerrainSnapshot> snapshot;
+    if (_snapshots.spare && _snapshots.spare.use_count() == 1) {
+        snapshot = _snapshots.spare; // no longer reachable through getSnapshot, so nobody can pick it up again
+    }
+    else {
+        snapshot = std::make_shared<TerrainSnapshot>();
+    }
+
+    snapshot->year = _year;
+    snapshot->height = _hydro.getHeightMapConst(); // same sizes, so these reuse the existing buffers
+    snapshot->heightFilled = _hydro.getHeightMapFilledConst();
+    snapshot->slope = _hydro.getSlopeConst();
+    snapshot->flowDirection = _hydro.getFlowDirectionConst();
+    snapshot->flowAccumulation = _hydro.getFlowAccumulationConst();
+    snapshot->isChannel = _hydro.getIsChannelConst();
+    snapshot->terrainTypes = _terrainType;
+    snapshot->burned = _burned;
+
+    _snapshots.spare = std::atomic_load(&_snapshots.current);
+    std::atomic_store(&_snapshots.current, snapshot);
+}
+
+// one unit of processYear, either a whole stage or a band of rows for the per-cell stages
+// returns true when the year is finished
+bool SLTerrain::stepUnit() {
     int rows = getRows();
     int cols = getCols();
+    int bandRows = std::max(1, _pipeline.stepBandRows);
 
-    _burned.assign(rows, std::vector<int>(cols, 0));
-    for (int i = 0; i < 4; i++) {//TODO param for num rnd wildfires a year-->or maybe actually a variable on this function?
-        rndWildfire(6);
-	}
-    //_hydro.basicFillSinksPinholesMin();
-    _hydro.calculateSlope(SLHydrology::DEGREE);// UPSED uses degree
-    _hydro.calculateDirection8();
-    _hydro.calculateAspect(SLHydrology::DEGREE);
-    printf("Slope and direction calculated\n");
+    switch (_stepStage) {
+    case STEP_WILDFIRE:
+        if (stageDue(_pipeline.wildfireInterval)) {
+            _burned.clear();
+            rndWildfires(_ter.wildfiresPerYear, _ter.wildfireIterations);
+        }
+        _stepStage = stageDue(_pipeline.erosionInterval) ? STEP_SLOPE : STEP_RIVERS;
+        break;
+
+    case STEP_SLOPE:
+        //_hydro.basicFillSinksPinholesMin();
+        _hydro.calculateSlope(SLHydrology::DEGREE);// UPSED uses degree
+        _stepStage++;
+        break;
+    case STEP_DIRECTION:
+        _hydro.calculateDirection8();
+        _stepStage++;
+        break;
+    case STEP_ASPECT:
+        _hydro.calculateAspect(SLHydrology::DEGREE);
+        printf("Slope and direction calculated\n");
+        _stepStage++;
+        break;
+    case STEP_FLOW:
+        _hydro.calculateFlowAccumulation();
+        _hydro.blurFlowAccumulation();
+        printf("Flow Accumulation Calculated\n");
+        _stepStage++;
+        break;
+
+    // run erosion and deposition on basic, unfilled terrain (channels may be from an earlier year)
+    case STEP_USPED:
+        calcCfactorFromTerrainTypes();
+        _hydro.USPED(1, &_Cfactor);
+        _stepStage++;
+        break;
+    case STEP_USPED_ADJUST:
+        blurAndOffsetUSPEDErosion();
+        additionalErosionDeposition();
+        _stepStage++;
+        _stepRow = 0;
+        _sumSquaredChange = 0;
+        break;
+    case STEP_HEIGHTS:
+        adjustHeightsBand(_stepRow, std::min(rows, _stepRow + bandRows));
+        _stepRow += bandRows;
+        if (_stepRow >= rows) {
+            _metrics.rmsHeightChange = std::sqrt(_sumSquaredChange / ((double)rows * cols));
+            printf("USPED erosion and deposition calculated\n");
+            _stepStage++;
+            _stepRow = 0;
+        }
+        break;
 
-    _hydro.calculateFlowAccumulation();
-    _hydro.blurFlowAccumulation();
-    printf("Flow Accumulation Calculated\n");
-    
-    // run erosion and deposition on basic, unfilled terrain
-    calcCfactorFromTerrainTypes();
-    _hydro.USPED(1, &_Cfactor);
-    blurAndOffsetUSPEDErosion();
-    additionalErosionDeposition();
-    adjustHeightsViaErosionDeposition();
-    printf("USPED erosion and deposition calculated\n");
+    case STEP_RIVERS:
+        if (!stageDue(_pipeline.riversAndLakesInterval)) {
+            _stepStage = STEP_CLASSIFY;
+        }
+        else if (_pipeline.overlapRiversAndLakes) {
+            joinRiversAndLakes(); // last analysis, run while this year's erosion was going
+            launchRiversAndLakes();
+            _stepStage = STEP_CLASSIFY;
+        }
+        else {
+            joinRiversAndLakes();
+            if (riversAndLakesUnit(_hydro, _stepRow++)) {
+                _riversYear = _year;
+                _stepStage = STEP_CLASSIFY;
+            }
+        }
+        if (_stepStage == STEP_CLASSIFY) {
+            _stepRow = 0;
+            if (stageDue(_pipeline.classifyInterval)) {
+                _classifyPending = true;
+            }
+            if (!_classifyPending || _riversYear != _year) {
+                _stepStage = STEP_DONE;
+            }
+        }
+        break;
 
-    // fill sinks and recalculate flow accumulation to create info for channels
-    _hydro.fillSinksWangLiu(0.00001);
-    _hydro.calculateDirection8(true);
-    _hydro.calculateFlowAccumulation();
-    printf("Filled Flow Accumulation Calculated\n");
-    _hydro.fillSinksWangLiu(0);
-    _hydro.calculateStrahlerOrder();
-    _hydro.calculateDirection8(true); // needs to be run one final time to get flats for categorizing lakes
-    printf("Strahler Order Calculated\n");
+    case STEP_CLASSIFY:
+        if (_stepRow == 0) {
+            prepareClassify();
+        }
+        classifyBand(_stepRow, std::min(rows, _stepRow + bandRows));
+        _stepRow += bandRows;
+        if (_stepRow >= rows) {
+            classifyDeposits();
+            _stepStage = STEP_DONE;
+        }
+        break;
 
-    _hydro.identifyChannelsByStrahler(3);
+    default:
+        _stepStage = STEP_DONE;
+        break;
+    }
+    return _stepStage == STEP_DONE;
 }
 
 // terrain generation iteration, a "year" (or say, a turn in a game)
@@ -128,6 +453,7 @@ void SLTerrain::processYear(int year) {
 void SLTerrain::processYearFast() {
     int rows = getRows();
     int cols = getCols();
+    advanceYear();
 
     _hydro.calculateSlope(SLHydrology::DEGREE); //UPSED uses DEGREE
     _hydro.calculateDirection8();
@@ -146,181 +472,831 @@ void SLTerrain::processYearFast() {
 
 // identify rivers and create flats for lakes using fill sinks
 void SLTerrain::processRiversAndLakes() {
-    int rows = getRows();
-    int cols = getCols();
+    joinRiversAndLakes(); // don't let an older background result land on top of this one
+    analyseRiversAndLakes(_hydro);
+    _riversYear = _year;
+}
+
+// the fills -> D8 -> flow -> strahler -> channels chain
+// only reads the heights, so it can also run on a snapshot on another thread
+void SLTerrain::analyseRiversAndLakes(SLHydrology& hydro) {
+    int unit = 0;
+    while (!riversAndLakesUnit(hydro, unit++)) {}
+}
 
+// one step of analyseRiversAndLakes (for step()), returns true after the last one
+bool SLTerrain::riversAndLakesUnit(SLHydrology& hydro, int unit) {
+    switch (unit) {
     // fill sinks and recalculate flow accumulation to create info for channels
-    _hydro.fillSinksWangLiu(0.00001);
-    _hydro.calculateDirection8(true);
-    _hydro.calculateFlowAccumulation();
-    printf("Filled Flow Accumulation Calculated\n");
-    _hydro.fillSinksWangLiu(0);
-    _hydro.calculateStrahlerOrder();
-    _hydro.calculateDirection8(true); // needs to be run one final time to get flats for categorizing lakes
-    printf("Strahler Order Calculated\n");
-    // identify channels by strahler order
-    _hydro.identifyChannelsByStrahler(3);
+    case 0: hydro.fillSinksWangLiu(0.00001); break;
+    case 1: hydro.calculateDirection8(true); break;
+    case 2:
+        hydro.calculateFlowAccumulation();
+        printf("Filled Flow Accumulation Calculated\n");
+        break;
+    case 3: hydro.fillSinksWangLiu(0); break;
+    case 4: hydro.calculateStrahlerOrder(); break;
+    case 5:
+        hydro.calculateDirection8(true); // needs to be run one final time to get flats for categorizing lakes
+        printf("Strahler Order Calculated\n");
+        break;
+    default:
+        // identify channels by strahler order
+        hydro.identifyChannelsByStrahler(3);
+        return true;
+    }
+    return false;
+}
+
+// a background analysis or a half stepped year belongs to the map being replaced (and may be
+// another size), so a new or loaded map starts without them
+void SLTerrain::dropPendingWork() {
+    _riversJob = std::shared_future<std::shared_ptr<SLHydrology>>();
+    _riversJobYear = -1;
+    _working.reset();
+    _copyUnit = 0;
+}
+
+// starts the analysis on a copy of the current heights
+void SLTerrain::launchRiversAndLakes() {
+    StdVec2Df z = _hydro.getHeightMapConst();
+    auto snapshot = std::make_shared<SLHydrology>(z, _hydro.getErosionParams());
+    snapshot->setRng(_hydro.getRng());
+    _riversJob = std::async(std::launch::async, [snapshot]() {
+        analyseRiversAndLakes(*snapshot);
+        return snapshot;
+    }).share();
+    _riversJobYear = _year;
 }
 
+// waits for the background analysis (if any) and swaps its layers in
+void SLTerrain::joinRiversAndLakes() {
+    if (!_riversJob.valid()) { return; }
+    std::shared_ptr<SLHydrology> result = _riversJob.get();
+    _riversJob = std::shared_future<std::shared_ptr<SLHydrology>>();
+
+    bool ok = _hydro.adoptLayer(SLHydrology::HEIGHT_FILLED, *result)
+        && _hydro.adoptLayer(SLHydrology::FLOW_DIRECTION, *result)
+        && _hydro.adoptLayer(SLHydrology::FLOW_DIRECTION_IN, *result)
+        && _hydro.adoptLayer(SLHydrology::FLOW_ACCUMULATION, *result)
+        && _hydro.adoptLayer(SLHydrology::STRAHLER_ORDER, *result)
+        && _hydro.adoptLayer(SLHydrology::IS_CHANNEL, *result);
+    if (!ok) { return; } // from another map, the stale stages get rebuilt
+    _riversYear = _year; // most recent completed analysis, even if from an earlier year's heights
+}
 
+// brings skipped stages up to date, so the outputs match the current heights
+void SLTerrain::refreshStaleStages() {
+    if (_riversJob.valid()) {
+        bool snapshotIsCurrent = _riversJobYear == _year;
+        joinRiversAndLakes();
+        if (!snapshotIsCurrent) { _riversYear = -1; }
+    }
+    if (_riversYear != _year) {
+        processRiversAndLakes();
+    }
+    if (_classifyYear != _year) {
+        calculateTerrainTypes();
+    }
+}
 
 
-void SLTerrain::save(std::ofstream& fout) {
-    saveMatrix(_hydro.getHeightMap(), fout);
-    saveMatrix(_hydro.getHeightMapFilled(), fout);
-    saveMatrix(_hydro.getFlowAccumulation(), fout);
-    saveMatrix(_hydro.getFlowDirection(), fout);
-    saveMatrix(_hydro.getFlowDirectionIn(), fout);
-    saveMatrix(_hydro.getSlope(), fout);
-    saveMatrix(_hydro.getAspect(), fout);
-    saveMatrix(_hydro.getStrahlerOrder(), fout);
-    saveMatrix(_terrainType, fout);
-    saveMatrix(_hydro.getErosionDeposition(), fout);
-    saveMatrix(_burned, fout);
 
-    saveVector(_ironDeposits, fout);
-    saveVector(_coalDeposits, fout);
-    saveVector(_bogIronDeposits, fout);
-    saveVector(_stoneDeposits, fout);
-    saveVector(_uraniumDeposits, fout);
 
+//---------------------------------------------------------------------------------------------------
+// saves are an SLContainer of named layers (see utils/slcontainer.h), so each layer can be found
+// directly and is checked on load. load still reads the raw saves from before the container
+
+static const char* DEPOSIT_ENTRIES[] = { "deposits.iron", "deposits.coal", "deposits.stone", "deposits.bogIron", "deposits.uranium" };
+static const SLHydrology::Layer SAVED_LAYERS[] = { SLHydrology::HEIGHT, SLHydrology::HEIGHT_FILLED, SLHydrology::FLOW_ACCUMULATION,
+    SLHydrology::FLOW_DIRECTION, SLHydrology::FLOW_DIRECTION_IN, SLHydrology::SLOPE, SLHydrology::ASPECT,
+    SLHydrology::STRAHLER_ORDER, SLHydrology::EROSION_DEPOSITION };
+
+bool SLTerrain::save(std::string path) {
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout.is_open()) {
+        printf("::::ERROR:::: save-> could not open %s\n", path.c_str());
+        return false;
+    }
+    return save(fout);
+}
+
+bool SLTerrain::load(std::string path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: load-> could not open %s\n", path.c_str());
+        return false;
+    }
+    return load(fin);
+}
+
+bool SLTerrain::save(std::ofstream& fout) {
+    bool ok = save(fout, _save);
     fout.close();
+    return ok;
+}
+
+bool SLTerrain::save(std::ostream& fout, const SaveParams& params) {
+    SLContainerWriter out(fout);
+    out.setCompression(params.compress, params.floatTolerance);
+    out.setThreads(_pipeline.threads);
+    SaveInfo info = { getRows(), getCols(), _year, _fbm.seed };
+    out.writeBlob("terrainInfo", &info, sizeof(info));
+    for (auto layer : SAVED_LAYERS) {
+        _hydro.saveLayer(layer, out);
+    }
+    _hydro.saveLayer(SLHydrology::BLURRED_FLOW_ACCUMULATION, out); // so load doesn't have to rebuild them
+    _hydro.saveLayer(SLHydrology::IS_CHANNEL, out);
+    out.writeGrid("terrainType", _terrainType);
+    out.writeVector("burned", getBurnedList());
+    for (int r = IRON; r <= URANIUM; r++) {
+        out.writeVector(DEPOSIT_ENTRIES[r - IRON], depositList((TerrainType)r));
+    }
+    return out.finish();
+}
+
+bool SLTerrain::load(std::ifstream& fin) {
+    if (!SLContainerReader::isContainer(fin)) {
+        return loadLegacy(fin);
+    }
+    SLContainerReader in;
+    in.setThreads(_pipeline.threads);
+    if (!in.open(fin)) {
+        return false;
+    }
+    return load(in);
+}
+
+bool SLTerrain::load(std::string path, const std::vector<std::string>& layers, SLContainer::Rect rect) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: load-> could not open %s\n", path.c_str());
+        return false;
+    }
+    if (!SLContainerReader::isContainer(fin)) {
+        printf("::::ERROR:::: load-> %s is an old raw save, only whole loads can read it\n", path.c_str());
+        return false;
+    }
+    SLContainerReader in;
+    in.setThreads(_pipeline.threads);
+    if (!in.open(fin)) {
+        return false;
+    }
+    return load(in, layers, rect);
 }
 
-void SLTerrain::load(std::ifstream& fin) {
-    loadMatrix(_hydro.getHeightMap(), fin);
-    loadMatrix(_hydro.getHeightMapFilled(), fin);
-    loadMatrix(_hydro.getFlowAccumulation(), fin);
-    loadMatrix(_hydro.getFlowDirection(), fin);
-    loadMatrix(_hydro.getFlowDirectionIn(), fin);
-    loadMatrix(_hydro.getSlope(), fin);
-    loadMatrix(_hydro.getAspect(), fin);
-    loadMatrix(_hydro.getStrahlerOrder(), fin);
+bool SLTerrain::load(SLContainerReader& in) {
+    return load(in, std::vector<std::string>(), SLContainer::Rect());
+}
+
+bool SLTerrain::load(SLContainerReader& in, const std::vector<std::string>& layers, SLContainer::Rect rect) {
+    dropPendingWork();
+    auto wanted = [&](const std::string& name) {
+        return layers.empty() || std::find(layers.begin(), layers.end(), name) != layers.end();
+    };
+    const SLContainer::Entry* heightEntry = in.find(SLHydrology::getLayerName(SLHydrology::HEIGHT));
+    if (!heightEntry) {
+        printf("::::ERROR:::: load-> save has no heights\n");
+        return false;
+    }
+    SaveInfo info;
+    std::string bytes;
+    if (in.has("terrainInfo") && in.readBlob("terrainInfo", bytes) && bytes.size() == sizeof(info)) {
+        std::memcpy(&info, bytes.data(), sizeof(info));
+        _year = info.year;
+        _fbm.seed = info.seed;
+    }
+    bool whole = rect.whole();
+    int fullCols = heightEntry->cols;
+    rect = SLContainer::clip(rect, heightEntry->rows, heightEntry->cols);
+    if (!whole && rect.whole()) {
+        printf("::::ERROR:::: load-> rect is outside the map\n");
+        return false;
+    }
+
+    // start from empty layers so nothing from a previous map survives a partial load
+    SLHydrology::ErosionParams ero = _hydro.getErosionParams();
+    _rng = SLCounterRng(_fbm.seed, _year); // so simulating on from here draws what the original run would have
+    _hydro = SLHydrology();
+    _hydro.setErosionParams(ero);
+    _hydro.setRng(_rng);
+
+    // heights always: they size the map and the rest are stamped as built from them
+    bool ok = _hydro.loadLayer(SLHydrology::HEIGHT, in, "", rect);
+    for (auto layer : SAVED_LAYERS) {
+        if (layer != SLHydrology::HEIGHT && wanted(SLHydrology::getLayerName(layer))) {
+            ok = ok && _hydro.loadLayer(layer, in, "", rect);
+        }
+    }
+    // saves from before these were stored get them rebuilt below (if asked for)
+    bool rebuildBlurred = false;
+    bool rebuildChannels = false;
+    for (auto layer : { SLHydrology::BLURRED_FLOW_ACCUMULATION, SLHydrology::IS_CHANNEL }) {
+        const char* name = SLHydrology::getLayerName(layer);
+        if (!wanted(name)) { continue; }
+        if (in.has(name)) {
+            ok = ok && _hydro.loadLayer(layer, in, "", rect);
+        }
+        else {
+            (layer == SLHydrology::IS_CHANNEL ? rebuildChannels : rebuildBlurred) = true;
+        }
+    }
+
+    _terrainType.assign(getRows(), std::vector<TerrainType>(getCols(), GRASSLAND));
+    if (wanted("terrainType")) {
+        ok = ok && in.readGrid("terrainType", _terrainType, rect);
+    }
+    // burned cells and deposits are lists, so a rect keeps the ones inside it (moved to its corner)
+    std::vector<BurnedCell> burned;
+    if (wanted("burned")) {
+        ok = ok && in.readVector("burned", burned);
+    }
+    if (!whole) {
+        std::vector<BurnedCell> inside;
+        for (auto& b : burned) {
+            int y = b.cell / fullCols - rect.y;
+            int x = b.cell % fullCols - rect.x;
+            if (x >= 0 && x < rect.width && y >= 0 && y < rect.height) {
+                inside.push_back({ y * rect.width + x, b.iteration });
+            }
+        }
+        burned.swap(inside);
+    }
+    ok = ok && setBurnedList(burned);
+    for (int r = IRON; r <= URANIUM; r++) {
+        std::vector<SLPoint>& deposits = depositList((TerrainType)r);
+        deposits.clear();
+        if (!wanted(DEPOSIT_ENTRIES[r - IRON])) { continue; }
+        ok = ok && in.readVector(DEPOSIT_ENTRIES[r - IRON], deposits);
+        if (!whole) {
+            std::vector<SLPoint> inside;
+            for (auto& p : deposits) {
+                if (p.x >= rect.x && p.x < rect.x + rect.width && p.y >= rect.y && p.y < rect.y + rect.height) {
+                    inside.push_back(SLPoint(p.x - rect.x, p.y - rect.y));
+                }
+            }
+            deposits.swap(inside);
+        }
+    }
+    if (!ok) {
+        printf("::::ERROR:::: load-> save is incomplete or damaged\n");
+        return false;
+    }
+
+    //regens
+    if (rebuildBlurred) {
+        _hydro.getBlurredFlowAccumulation();
+    }
+    if (rebuildChannels) {
+        _hydro.getStrahlerOrder();
+        _hydro.identifyChannelsByStrahler(3);
+    }
+    rebuildDepositIndex();
+    return true;
+}
+
+// raw layers one after the other, as written before the container format
+bool SLTerrain::loadLegacy(std::ifstream& fin) {
+    dropPendingWork();
+    _hydro.loadLayer(SLHydrology::HEIGHT, fin); // first, the rest are stamped as built from these heights
+    _hydro.loadLayer(SLHydrology::HEIGHT_FILLED, fin);
+    _hydro.loadLayer(SLHydrology::FLOW_ACCUMULATION, fin);
+    _hydro.loadLayer(SLHydrology::FLOW_DIRECTION, fin);
+    _hydro.loadLayer(SLHydrology::FLOW_DIRECTION_IN, fin);
+    _hydro.loadLayer(SLHydrology::SLOPE, fin);
+    _hydro.loadLayer(SLHydrology::ASPECT, fin);
+    _hydro.loadLayer(SLHydrology::STRAHLER_ORDER, fin);
     loadMatrix(_terrainType, fin);
-    loadMatrix(_hydro.getErosionDeposition(), fin);
-    loadMatrix(_burned, fin);
+    _hydro.loadLayer(SLHydrology::EROSION_DEPOSITION, fin);
+    // burned cells were a full matrix of burn iterations then, 0 for unburned
+    StdVec2Di burnedMatrix;
+    loadMatrix(burnedMatrix, fin);
+    int cols = getCols();
+    bool ok = burnedMatrix.size() == getRows();
+    std::vector<BurnedCell> burned;
+    for (int i = 0; ok && i < (int)burnedMatrix.size(); i++) {
+        ok = burnedMatrix[i].size() == cols;
+        for (int j = 0; ok && j < cols; j++) {
+            if (burnedMatrix[i][j] != 0) {
+                burned.push_back({ i * cols + j, burnedMatrix[i][j] });
+            }
+        }
+    }
+    ok = ok && setBurnedList(burned);
 
     loadVector(_ironDeposits, fin);
     loadVector(_coalDeposits, fin);
     loadVector(_bogIronDeposits, fin);
     loadVector(_stoneDeposits, fin);
     loadVector(_uraniumDeposits, fin);
-
-    int rows = getRows();
-    int cols = getCols();//TODO error checking
+    if (!fin.good() || !ok) {
+        printf("::::ERROR:::: load-> save is truncated or damaged\n");
+        return false;
+    }
+    if (fin.peek() != std::char_traits<char>::eof()) {
+        printf("::::ERROR:::: load-> unexpected data after the last layer, not an old raw save\n");
+        return false;
+    }
 
     //regens
     _hydro.blurFlowAccumulation();
     _hydro.identifyChannelsByStrahler(3);
+    rebuildDepositIndex();
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// checkpoints, the same container with every layer plus the generation state. written to a temp
+// file first so a run killed mid-write still has its previous checkpoint
+
+static const int CHECKPOINT_VERSION = 3;
+
+bool SLTerrain::saveCheckpoint(std::string path) {
+    std::string tmpPath = path + ".tmp";
+    std::ofstream fout(tmpPath, std::ios::binary);
+    if (!fout.is_open()) {
+        printf("::::ERROR:::: saveCheckpoint-> could not open %s\n", tmpPath.c_str());
+        return false;
+    }
+
+    // a background analysis in flight is part of the state, so wait for it and save its result too
+    std::shared_ptr<SLHydrology> pending;
+    if (_riversJob.valid()) {
+        pending = _riversJob.get();
+    }
+    bool hasPending = pending != nullptr;
+
+    std::ostringstream state;
+    saveValue(CHECKPOINT_VERSION, state);
+    saveValue(_fbm, state);
+    saveValue(_ter, state);
+    saveValue(_pipeline, state);
+    saveValue(_rng, state);
+    saveValue(_year, state);
+    saveValue(_wildfireCount, state);
+    saveValue(_genPhase, state);
+    saveValue(_genIteration, state);
+
+    saveValue(_metrics, state);
+    saveValue(_erosionIterationsUsed, state);
+    saveValue(_convergedIterations, state);
+
+    saveValue(_riversYear, state);
+    saveValue(_classifyYear, state);
+    saveValue(_classifyPending, state);
+    saveValue(hasPending, state);
+    saveValue(_riversJobYear, state);
+
+    SLContainerWriter out(fout);
+    out.setCompression(_save.compress); // never lossy, resume has to be exact
+    out.setThreads(_pipeline.threads);
+    out.writeBlob("checkpoint", state.str());
+    out.writeVector("classifierRules", _classifierRules);
+    out.writeGrid("prevFlowDirection", _prevFlowDirection);
+    out.writeVector("burned", getBurnedList());
+    out.writeGrid("terrainType", _terrainType);
+    out.writeGrid("cFactor", _Cfactor);
+    for (int r = IRON; r <= URANIUM; r++) {
+        out.writeVector(DEPOSIT_ENTRIES[r - IRON], depositList((TerrainType)r));
+    }
+    _hydro.saveState(out);
+    if (hasPending) {
+        pending->saveState(out, "pending.");
+    }
+
+    bool ok = out.finish();
+    fout.close();
+    if (!ok) {
+        printf("::::ERROR:::: saveCheckpoint-> write failed for %s\n", tmpPath.c_str());
+        return false;
+    }
+    std::error_code error; // replaces the old checkpoint in one step (std::rename won't on windows)
+    std::filesystem::rename(tmpPath, path, error);
+    if (error) {
+        printf("::::ERROR:::: saveCheckpoint-> could not move checkpoint to %s\n", path.c_str());
+        return false;
+    }
+    _lastCheckpointYear = _year;
+    printf("Checkpoint saved at year %d: %s\n", _year, path.c_str());
+    return true;
+}
+
+bool SLTerrain::loadCheckpoint(std::string path) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: loadCheckpoint-> could not open %s\n", path.c_str());
+        return false;
+    }
+    SLContainerReader in;
+    in.setThreads(_pipeline.threads);
+    std::string bytes;
+    int version = 0;
+    if (!in.open(fin) || !in.has("checkpoint") || !in.readBlob("checkpoint", bytes)) {
+        printf("::::ERROR:::: loadCheckpoint-> %s is not a checkpoint\n", path.c_str());
+        return false;
+    }
+    std::istringstream state(bytes);
+    loadValue(version, state);
+    if (version != CHECKPOINT_VERSION) {
+        printf("::::ERROR:::: loadCheckpoint-> %s is a version %d checkpoint, expected %d\n", path.c_str(), version, CHECKPOINT_VERSION);
+        return false;
+    }
+    dropPendingWork();
+
+    bool hasPending = false;
+    loadValue(_fbm, state);
+    loadValue(_ter, state);
+    loadValue(_pipeline, state);
+    loadValue(_rng, state);
+    loadValue(_year, state);
+    loadValue(_wildfireCount, state);
+    loadValue(_genPhase, state);
+    loadValue(_genIteration, state);
+
+    loadValue(_metrics, state);
+    loadValue(_erosionIterationsUsed, state);
+    loadValue(_convergedIterations, state);
+
+    loadValue(_riversYear, state);
+    loadValue(_classifyYear, state);
+    loadValue(_classifyPending, state);
+    loadValue(hasPending, state);
+    bool ok = loadValue(_riversJobYear, state);
+
+    ok = ok && in.readVector("classifierRules", _classifierRules);
+    ok = ok && in.readGrid("prevFlowDirection", _prevFlowDirection);
+    std::vector<BurnedCell> burned;
+    ok = ok && in.readVector("burned", burned);
+    ok = ok && in.readGrid("terrainType", _terrainType);
+    ok = ok && in.readGrid("cFactor", _Cfactor);
+    for (int r = IRON; r <= URANIUM; r++) {
+        ok = ok && in.readVector(DEPOSIT_ENTRIES[r - IRON], depositList((TerrainType)r));
+    }
+    ok = ok && _hydro.loadState(in);
+    ok = ok && setBurnedList(burned); // after the heights, which give the map size
+
+    if (ok && hasPending) {
+        auto pending = std::make_shared<SLHydrology>();
+        ok = pending->loadState(in, "pending.");
+        std::promise<std::shared_ptr<SLHydrology>> done; // already finished, joined like a live job
+        done.set_value(pending);
+        _riversJob = done.get_future().share();
+    }
+
+    if (!ok) {
+        printf("::::ERROR:::: loadCheckpoint-> %s is incomplete or damaged\n", path.c_str());
+        return false;
+    }
+    rebuildDepositIndex();
+    _lastCheckpointYear = _year;
+    printf("Checkpoint loaded at year %d: %s\n", _year, path.c_str());
+    return true;
+}
+
+bool SLTerrain::resume(std::string path) {
+    if (!loadCheckpoint(path)) {
+        return false;
+    }
+    _genStart = std::chrono::steady_clock::now();
+    runGeneration();
+    return true;
+}
+
+StdVec2Di SLTerrain::getBurned() {
+    int cols = getCols();
+    StdVec2Di burned(getRows(), std::vector<int>(cols, 0));
+    for (auto& cell : _burned) {
+        burned[cell.first / cols][cell.first % cols] = cell.second;
+    }
+    return burned;
+}
+
+// saved as a (cell, iteration) list sorted by cell, so the same state always saves the same bytes
+std::vector<SLTerrain::BurnedCell> SLTerrain::getBurnedList() {
+    std::vector<BurnedCell> cells;
+    for (auto& cell : _burned) {
+        cells.push_back({ cell.first, cell.second });
+    }
+    std::sort(cells.begin(), cells.end(), [](const BurnedCell& a, const BurnedCell& b) { return a.cell < b.cell; });
+    return cells;
+}
+
+// cells outside the map (a damaged file) are dropped and make this return false
+bool SLTerrain::setBurnedList(const std::vector<BurnedCell>& cells) {
+    int64_t size = (int64_t)getRows() * getCols();
+    bool valid = true;
+    _burned.clear();
+    for (auto& cell : cells) {
+        if (cell.cell < 0 || cell.cell >= size) {
+            valid = false;
+            continue;
+        }
+        _burned[cell.cell] = cell.iteration;
+    }
+    return valid;
 }
 
 // simple random placement according to terrain type
 void SLTerrain::addRndResouceDeposits() {
     int rows = getRows();
     int cols = getCols();
-    auto& slope = _hydro.getSlope();
+    _hydro.ensureLayer(SLHydrology::SLOPE);
+    auto& slope = _hydro.getSlopeConst(); // as classification saw it
 
     for (int i = 0; i < rows; i++) {
         for (int j = 0; j < cols; j++) {
             if (_terrainType[i][j] == MOUNTAIN || _terrainType[i][j] == PLATEAU || slope[i][j] > 35) {
-                if (SLRng::getFloat(0, 1) < 0.01) {
+                int cell = i * cols + j;
+                if (_rng.getFloat(RNG_RESOURCE_IRON, cell, 0, 1) < 0.01) {
                     _ironDeposits.push_back({ j, i });
                 }
-                else if (SLRng::getFloat(0, 1) < 0.01) {
+                else if (_rng.getFloat(RNG_RESOURCE_COAL, cell, 0, 1) < 0.01) {
                     _coalDeposits.push_back({ j, i });
                 }
-                else if (SLRng::getFloat(0, 1) < 0.0007) {
+                else if (_rng.getFloat(RNG_RESOURCE_URANIUM, cell, 0, 1) < 0.0007) {
                     _uraniumDeposits.push_back({ j, i });
                 }
 			}
             if (_terrainType[i][j] == VALLEY) {
-                if (SLRng::getFloat(0, 1) < 0.005) {
+                if (_rng.getFloat(RNG_RESOURCE_BOG_IRON, i * cols + j, 0, 1) < 0.005) {
                     _bogIronDeposits.push_back({ j, i });
                 }
             }
-            else if (_terrainType[i][j] != MOUNTAIN && SLRng::getFloat(0, 1) < 0.01) {
+            else if (_terrainType[i][j] != MOUNTAIN && _rng.getFloat(RNG_RESOURCE_STONE, i * cols + j, 0, 1) < 0.01) {
                 _stoneDeposits.push_back({ j, i });
             }
         }
     }
+    rebuildDepositIndex();
 }
 
-// based on flow, slope and elevation
+// based on flow, slope and elevation, see ClassifierRule
 void SLTerrain::calculateTerrainTypes() {
-    int rows = getRows();
-    int cols = getCols();
-    auto& z = _hydro.getHeightMap();
-    auto& slope = _hydro.getSlope();
-    auto& isChannel = _hydro.getIsChannel();
-    auto& flowDirection = _hydro.getFlowDirection();
-    auto& flowAccumulation = _hydro.getFlowAccumulation();
-    auto& blurredFlowAccumulation = _hydro.getBlurredFlowAccumulation();
+    prepareClassify();
+    parallelFor(0, getRows(), _pipeline.threads, [&](int rowStart, int rowEnd) { classifyBand(rowStart, rowEnd); });
+    classifyDeposits();
+}
 
-    for (int i = 0; i < rows; i++) {
-        for (int j = 0; j < cols; j++) {
-            if (flowDirection[i][j] == 0) { //(_z[i][j] < 30) { //original just used min elevation
-                _terrainType[i][j] = STANDING_WATER;
-                continue;
+// the built-in rules (what the old if/else chain did)
+std::vector<SLTerrain::ClassifierRule> SLTerrain::defaultClassifierRules() {
+    std::vector<ClassifierRule> rules;
+    rules.push_back(ClassifierRule(STANDING_WATER).greater(FEATURE_FLAT, 0.5f)); // original just used min elevation
+    rules.push_back(ClassifierRule(RIVER).greater(FEATURE_CHANNEL, 0.5f));
+    // only remove forests if water
+    rules.push_back(ClassifierRule(FOREST, true).greater(FEATURE_FOREST, 0.5f).less(FEATURE_CHANNEL, 0.5f).greater(FEATURE_BLURRED_FLOW, 2));
+    rules.push_back(ClassifierRule(GLACIER).greater(FEATURE_RIDGE_HEIGHT, 85));
+    rules.push_back(ClassifierRule(MOUNTAIN).greater(FEATURE_RIDGE_HEIGHT, 72));
+    rules.push_back(ClassifierRule(PLATEAU).greater(FEATURE_HEIGHT, 45).less(FEATURE_SLOPE, 15));
+    rules.push_back(ClassifierRule(VALLEY).less(FEATURE_HEIGHT, 45).less(FEATURE_SLOPE, 10).greater(FEATURE_BLURRED_FLOW, 10));
+    rules.push_back(ClassifierRule(FOREST).greater(FEATURE_FLOW, 5).less(FEATURE_BURNED, 1).less(FEATURE_RANDOM, 0.25f));
+    rules.push_back(ClassifierRule(GRASSLAND));
+    return rules;
+}
+
+// one rule per line: a type (e.g. MOUNTAIN, or KEEP to leave the cell as it is) followed by
+// conditions like "height>45" or "slope<15". blank lines and lines starting with # are skipped
+bool SLTerrain::loadClassifierRules(std::string path) {
+    static const char* typeNames[] = { "GRASSLAND", "FOREST", "VALLEY", "MOUNTAIN", "GLACIER", "PLATEAU",
+        "STANDING_WATER", "RIVER", "IRON", "COAL", "STONE", "BOG_IRON", "URANIUM" };
+    static const char* featureNames[FEATURE_COUNT] = { "height", "ridgeHeight", "slope", "flow", "blurredFlow",
+        "burned", "channel", "flat", "forest", "random" };
+
+    std::ifstream file(path);
+    if (!file.is_open()) {
+        printf("::::ERROR:::: loadClassifierRules-> could not open %s\n", path.c_str());
+        return false;
+    }
+    std::vector<ClassifierRule> rules;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line)) {
+        lineNumber++;
+        std::stringstream tokens(line);
+        std::string token;
+        if (!(tokens >> token) || token[0] == '#') {
+            continue;
+        }
+
+        ClassifierRule rule;
+        if (token == "KEEP") {
+            rule.keepCurrent = true;
+        }
+        else {
+            int type = URANIUM + 1;
+            for (int t = 0; t <= URANIUM; t++) {
+                if (token == typeNames[t]) { type = t; }
             }
-            if (isChannel[i][j]) {
-                _terrainType[i][j] = RIVER;
-                continue;
+            if (type > URANIUM) {
+                printf("::::ERROR:::: loadClassifierRules-> %s:%d unknown type %s\n", path.c_str(), lineNumber, token.c_str());
+                return false;
             }
+            rule.type = (TerrainType)type;
+        }
 
-            // only remnove forests if water
-            if (_terrainType[i][j] == FOREST && isChannel[i][j] == false && blurredFlowAccumulation[i][j] > 2) {
-				continue;
-			}
-
-            // instead of relying on flow direction could maybe mark areas as standing water in fill sinks??
-            if (z[i][j] > 72 && flowDirection[i][j] == 0) {
-                _terrainType[i][j] = GLACIER;
+        while (tokens >> token) {
+            size_t op = token.find_first_of("<>");
+            int feature = FEATURE_COUNT;
+            for (int f = 0; f < FEATURE_COUNT && op != std::string::npos; f++) {
+                if (token.compare(0, op, featureNames[f]) == 0) { feature = f; }
             }
-            else if (z[i][j] + 10/flowAccumulation[i][j] > 85) {
-				_terrainType[i][j] = GLACIER;
-			}
-            else if (z[i][j] + 10/flowAccumulation[i][j] > 72) {
-				_terrainType[i][j] = MOUNTAIN;
-			}
-            else if (z[i][j] > 45 && slope[i][j] < 15) {
-				_terrainType[i][j] = PLATEAU;
-			}
-            else if (z[i][j] < 45 && slope[i][j] < 10 && blurredFlowAccumulation[i][j] > 10) {
-                _terrainType[i][j] = VALLEY;
+            if (feature == FEATURE_COUNT || op + 1 >= token.size()) {
+                printf("::::ERROR:::: loadClassifierRules-> %s:%d bad condition %s\n", path.c_str(), lineNumber, token.c_str());
+                return false;
+            }
+            float value = std::stof(token.substr(op + 1));
+            if (token[op] == '>') {
+                rule.greater((ClassifierFeature)feature, value);
             }
-            else if (flowAccumulation[i][j] > 5 && _burned[i][j] < 1 && SLRng::getFloat(0,1) < 0.25) {
-				_terrainType[i][j] = FOREST;
-			}
             else {
-                _terrainType[i][j] = GRASSLAND;
+                rule.less((ClassifierFeature)feature, value);
             }
         }
+        rules.push_back(rule);
     }
+    _classifierRules = rules;
+    return true;
+}
 
-    //loop resource desposits and make sure to add back in 
-    for (auto& deposit : _ironDeposits) {
-        if (_terrainType[deposit.y][deposit.x] != STANDING_WATER) {
-            _terrainType[deposit.y][deposit.x] = IRON;
-        }
-	}
-    for (auto& deposit : _coalDeposits) {
-        if (_terrainType[deposit.y][deposit.x] != STANDING_WATER) {
-            _terrainType[deposit.y][deposit.x] = COAL;
+void SLTerrain::prepareClassify() {
+    // the layers as the year left them (slope and blurred flow from before its erosion, D8 and flow
+    // from the rivers stage), not rebuilt for the new heights. only missing ones are built
+    _hydro.ensureLayer(SLHydrology::SLOPE);
+    _hydro.ensureLayer(SLHydrology::FLOW_DIRECTION);
+    _hydro.ensureLayer(SLHydrology::FLOW_ACCUMULATION);
+    _hydro.ensureLayer(SLHydrology::BLURRED_FLOW_ACCUMULATION);
+}
+
+// rows [rowStart, rowEnd) of calculateTerrainTypes, after prepareClassify. only reads the
+// layers, so bands can run in any order and on any thread
+// works a row at a time: gathers the features the rules use into flat arrays, then applies the
+// rules last to first as selects, so the first matching rule wins without branching per cell
+void SLTerrain::classifyBand(int rowStart, int rowEnd) {
+    int cols = getCols();
+    auto& z = _hydro.getHeightMapConst();
+    auto& slope = _hydro.getSlopeConst();
+    auto& isChannel = _hydro.getIsChannelConst();
+    auto& flowDirection = _hydro.getFlowDirectionConst();
+    auto& flowAccumulation = _hydro.getFlowAccumulationConst();
+    auto& blurredFlowAccumulation = _hydro.getBlurredFlowAccumulationConst();
+
+    // conditions each rule actually checks, and the features needed at all
+    bool used[FEATURE_COUNT] = {};
+    std::vector<std::vector<int>> ruleFeatures(_classifierRules.size());
+    for (size_t r = 0; r < _classifierRules.size(); r++) {
+        for (int f = 0; f < FEATURE_COUNT; f++) {
+            if (_classifierRules[r].uses(f)) {
+                ruleFeatures[r].push_back(f);
+                used[f] = true;
+            }
         }
     }
-    for (auto& deposit : _bogIronDeposits) {
-        if (_terrainType[deposit.y][deposit.x] != STANDING_WATER) {
-            _terrainType[deposit.y][deposit.x] = BOG_IRON;
+
+    std::vector<std::vector<float>> feature(FEATURE_COUNT);
+    for (int f = 0; f < FEATURE_COUNT; f++) {
+        if (used[f]) { feature[f].resize(cols); }
+    }
+    std::vector<TerrainType> result(cols);
+    std::vector<unsigned char> match(cols);
+
+    for (int i = rowStart; i < rowEnd; i++) {
+        const float* zRow = z[i].data();
+        const uint64_t* flowRow = flowAccumulation[i].data();
+        TerrainType* typeRow = _terrainType[i].data();
+
+        if (used[FEATURE_HEIGHT]) {
+            std::copy(zRow, zRow + cols, feature[FEATURE_HEIGHT].begin());
         }
-	}
-    for (auto& deposit : _stoneDeposits) {
-        if (_terrainType[deposit.y][deposit.x] != STANDING_WATER) {
-            _terrainType[deposit.y][deposit.x] = STONE;
+        if (used[FEATURE_RIDGE_HEIGHT]) {
+            float* out = feature[FEATURE_RIDGE_HEIGHT].data();
+            for (int j = 0; j < cols; j++) {
+                uint64_t flow = flowRow[j] > 0 ? flowRow[j] : 1;
+                out[j] = zRow[j] + 10 / flow;
+            }
         }
-	}
-    for (auto& deposit : _uraniumDeposits) {
-        if (_terrainType[deposit.y][deposit.x] != STANDING_WATER) {
-            _terrainType[deposit.y][deposit.x] = URANIUM;
+        if (used[FEATURE_SLOPE]) {
+            std::copy(slope[i].begin(), slope[i].end(), feature[FEATURE_SLOPE].begin());
+        }
+        if (used[FEATURE_FLOW]) {
+            float* out = feature[FEATURE_FLOW].data();
+            for (int j = 0; j < cols; j++) { out[j] = (float)flowRow[j]; }
+        }
+        if (used[FEATURE_BLURRED_FLOW]) {
+            std::copy(blurredFlowAccumulation[i].begin(), blurredFlowAccumulation[i].end(), feature[FEATURE_BLURRED_FLOW].begin());
+        }
+        if (used[FEATURE_BURNED]) {
+            float* out = feature[FEATURE_BURNED].data();
+            for (int j = 0; j < cols; j++) { out[j] = 0; }
+            if (!_burned.empty()) {
+                for (int j = 0; j < cols; j++) { out[j] = (float)burnedAt(i * cols + j); }
+            }
+        }
+        if (used[FEATURE_CHANNEL]) {
+            float* out = feature[FEATURE_CHANNEL].data();
+            for (int j = 0; j < cols; j++) { out[j] = isChannel[i][j] ? 1.0f : 0.0f; }
+        }
+        if (used[FEATURE_FLAT]) {
+            const int* dirRow = flowDirection[i].data();
+            float* out = feature[FEATURE_FLAT].data();
+            for (int j = 0; j < cols; j++) { out[j] = dirRow[j] == 0 ? 1.0f : 0.0f; }
+        }
+        if (used[FEATURE_FOREST]) {
+            float* out = feature[FEATURE_FOREST].data();
+            for (int j = 0; j < cols; j++) { out[j] = typeRow[j] == FOREST ? 1.0f : 0.0f; }
+        }
+        if (used[FEATURE_RANDOM]) {
+            float* out = feature[FEATURE_RANDOM].data();
+            for (int j = 0; j < cols; j++) { out[j] = _rng.getFloat(RNG_FOREST, i * cols + j, 0, 1); }
+        }
+
+        std::fill(result.begin(), result.end(), GRASSLAND);
+        for (int r = (int)_classifierRules.size() - 1; r >= 0; r--) {
+            const ClassifierRule& rule = _classifierRules[r];
+            std::fill(match.begin(), match.end(), 1);
+            for (int f : ruleFeatures[r]) {
+                const float* in = feature[f].data();
+                float lo = rule.minValue[f];
+                float hi = rule.maxValue[f];
+                for (int j = 0; j < cols; j++) {
+                    match[j] &= (in[j] > lo) & (in[j] < hi);
+                }
+            }
+            if (rule.keepCurrent) {
+                for (int j = 0; j < cols; j++) { result[j] = match[j] ? typeRow[j] : result[j]; }
+            }
+            else {
+                for (int j = 0; j < cols; j++) { result[j] = match[j] ? rule.type : result[j]; }
+            }
+        }
+        std::copy(result.begin(), result.end(), typeRow);
+    }
+}
+
+// resources stay on top of whatever the cells were classified as
+void SLTerrain::classifyDeposits() {
+    _classifyYear = _year;
+    _classifyPending = false;
+
+    //loop resource desposits and make sure to add back in
+    // (the index only changes for deposits that flooded or dried out since last time)
+    for (int r = IRON; r <= URANIUM; r++) {
+        SLPointIndex& index = _depositIndex[r - IRON];
+        for (auto& deposit : depositList((TerrainType)r)) {
+            bool flooded = _terrainType[deposit.y][deposit.x] == STANDING_WATER;
+            if (!flooded) {
+                _terrainType[deposit.y][deposit.x] = (TerrainType)r;
+            }
+            if (flooded == index.contains(deposit)) {
+                if (flooded) {
+                    index.remove(deposit);
+                }
+                else {
+                    index.insert(deposit);
+                }
+            }
+        }
+    }
+}
+
+std::vector<SLPoint>& SLTerrain::depositList(TerrainType resource) {
+    switch (resource) {
+    case IRON: return _ironDeposits;
+    case COAL: return _coalDeposits;
+    case STONE: return _stoneDeposits;
+    case BOG_IRON: return _bogIronDeposits;
+    default: return _uraniumDeposits;
+    }
+}
+
+const std::vector<SLPoint>& SLTerrain::getDeposits(TerrainType resource) {
+    static const std::vector<SLPoint> none;
+    if (resource < IRON || resource > URANIUM) {
+        printf("::::ERROR:::: getDeposits-> %s is not a resource\n", getTerrainTypeName(resource).c_str());
+        return none;
+    }
+    return depositList(resource);
+}
+
+const SLPointIndex& SLTerrain::getDepositIndex(TerrainType resource) {
+    static const SLPointIndex none;
+    if (resource < IRON || resource > URANIUM) {
+        printf("::::ERROR:::: getDepositIndex-> %s is not a resource\n", getTerrainTypeName(resource).c_str());
+        return none;
+    }
+    return _depositIndex[resource - IRON];
+}
+
+// from scratch, for new or loaded deposit lists
+void SLTerrain::rebuildDepositIndex() {
+    int rows = getRows();
+    int cols = getCols();
+    bool haveTypes = (int)_terrainType.size() == rows && rows > 0 && (int)_terrainType[0].size() == cols;
+    for (int r = IRON; r <= URANIUM; r++) {
+        SLPointIndex& index = _depositIndex[r - IRON];
+        index.reset(cols, rows);
+        for (auto& deposit : depositList((TerrainType)r)) {
+            if (!haveTypes || _terrainType[deposit.y][deposit.x] != STANDING_WATER) {
+                index.insert(deposit);
+            }
         }
     }
 }
@@ -336,13 +1312,13 @@ StdVec2Df SLTerrain::FBMGenerator(FBMParams fbmParams, int rows, int cols) {
     int offsetX = fbmParams.offsetX;
     int offsetY = fbmParams.offsetY;
     if (offsetX == 0) {
-        offsetX = SLRng::getInt(0, 100000);
+        offsetX = _rng.getInt(RNG_OFFSETS, 0, 0, 100000);
     }
     if (offsetY == 0)
-        offsetY = SLRng::getInt(0, 100000); {
+        offsetY = _rng.getInt(RNG_OFFSETS, 1, 0, 100000); {
     }
 
-    PerlinNoise2D pNoise = PerlinNoise2D();
+    PerlinNoise2D pNoise = PerlinNoise2D(SLCounterRng::combine(fbmParams.seed, 0));
 
     StdVec2Df z(rows, std::vector<float>(cols, 0));
 
@@ -400,7 +1376,7 @@ void SLTerrain::blurAndOffsetUSPEDErosion() {
         }
     }
 
-    blur(erosionDeposition, SLRng::getFloat(_ter.USPEDminBlur, _ter.USPEDmaxBlur), 0.36);// make params?
+    blur(erosionDeposition, _rng.getFloat(RNG_USPED_BLUR, 0, _ter.USPEDminBlur, _ter.USPEDmaxBlur), 0.36);// make params?
 }
 
 
@@ -414,7 +1390,7 @@ void SLTerrain::additionalErosionDeposition() {
     int rows = getRows();
     int cols = getCols();
     auto& slope = _hydro.getSlope();
-    auto& z = _hydro.getHeightMap();
+    auto& z = _hydro.getHeightMapConst();
     auto& flowDirection = _hydro.getFlowDirection();
     auto& flowAccumulation = _hydro.getFlowAccumulation();
     auto& isChannel = _hydro.getIsChannel();
@@ -612,15 +1588,23 @@ void SLTerrain::additionalErosionDeposition() {
 
 // add erosion/deposition to the height map based on an arbitrary multiplier "converter"
 void SLTerrain::adjustHeightsViaErosionDeposition() {
-    int rows = getRows();
+    _sumSquaredChange = 0;
+    adjustHeightsBand(0, getRows());
+    _metrics.rmsHeightChange = std::sqrt(_sumSquaredChange / ((double)getRows() * getCols()));
+}
+
+// rows [rowStart, rowEnd) of adjustHeightsViaErosionDeposition, adds to _sumSquaredChange
+void SLTerrain::adjustHeightsBand(int rowStart, int rowEnd) {
     int cols = getCols();
     auto& z = _hydro.getHeightMap();
     auto& erosionDeposition = _hydro.getErosionDeposition();
 
-    for (int i = 0; i < rows; i++) {
+    for (int i = rowStart; i < rowEnd; i++) {
         for (int j = 0; j < cols; j++) {
-            float toAdd = erosionDeposition[i][j] * _hydro.getErosionParams().converter * SLRng::getFloat(.75, 1);
-            z[i][j] += toAdd * (0.5 + z[i][j] * 0.005);
+            float toAdd = erosionDeposition[i][j] * _hydro.getErosionParams().converter * _rng.getFloat(RNG_HEIGHT_ADJUST, i * cols + j, .75, 1);
+            float change = toAdd * (0.5 + z[i][j] * 0.005);
+            z[i][j] += change;
+            _sumSquaredChange += change * change;
         }
     }
 }
@@ -631,21 +1615,127 @@ void SLTerrain::rndWildfire(int iterations) {
     int cols = getCols();
     auto& flowAccumulation = _hydro.getFlowAccumulation();
 
-    int x = SLRng::getFloat(iterations, cols- iterations); //so can skip bounds checks
-    int y = SLRng::getFloat(iterations, rows- iterations);
+    int attempt = _wildfireCount++;
+    int x = _rng.getFloat(RNG_WILDFIRE_IGNITION, attempt * 2, iterations, cols - iterations); //so can skip bounds checks
+    int y = _rng.getFloat(RNG_WILDFIRE_IGNITION, attempt * 2 + 1, iterations, rows - iterations);
     if (_terrainType[y][x] == MOUNTAIN || _terrainType[y][x] == STANDING_WATER || flowAccumulation[y][x] > 10) { 
         return; 
     }
-    if (_burned[y][x] >= 1) { return; }
+    if (burnedAt(y * cols + x) >= 1) { return; }
 
     wildfire(x, y, iterations);
 }
 
-void SLTerrain::wildfire(int x, int y, int iterations) {
+// lights all the fires first, then spreads them together on one frontier. Unlike wildfire, a spread
+// step only sees the map as it was at the start of the step (a cell burns once whichever fire
+// reaches it), so the frontier can be split across threads without changing the result
+void SLTerrain::rndWildfires(int fires, int iterations) {
     int rows = getRows();
     int cols = getCols();
+    auto& flowAccumulation = _hydro.getFlowAccumulation();
+
+    // cells burned by this batch (cell index -> iteration it caught) and the ones still able to spread
+    std::unordered_map<int, int> burning;
+    std::vector<int> frontier;
+    for (int f = 0; f < fires; f++) {
+        int attempt = _wildfireCount++;
+        int x = _rng.getFloat(RNG_WILDFIRE_IGNITION, attempt * 2, iterations, cols - iterations);
+        int y = _rng.getFloat(RNG_WILDFIRE_IGNITION, attempt * 2 + 1, iterations, rows - iterations);
+        if (_terrainType[y][x] == MOUNTAIN || _terrainType[y][x] == STANDING_WATER || flowAccumulation[y][x] > 10) {
+            continue;
+        }
+        if (burnedAt(y * cols + x) >= 1) { continue; }
+
+        // avoid edges
+        if (x <= iterations) { x = iterations + 1; }
+        else if (x > cols - iterations - 1) { x = cols - iterations - 2; }
+        if (y <= iterations) { y = iterations + 1; }
+        else if (y > rows - iterations - 1) { y = rows - iterations - 2; }
+
+        if (burning.count(y * cols + x) == 0) {
+            burning[y * cols + x] = 1;
+            frontier.push_back(y * cols + x);
+        }
+    }
+    uint64_t batchKey = _wildfireCount++;
+
+    for (int iteration = 1; iteration <= iterations && frontier.size() > 0; iteration++) {
+        uint64_t iterationKey = SLCounterRng::combine(batchKey, iteration);
+        std::sort(frontier.begin(), frontier.end());
+
+        // find what catches (read only, so chunks can run in parallel), then apply it
+        int chunks = std::max(1, std::min(_pipeline.threads, (int)frontier.size() / 64));
+        std::vector<std::vector<int>> chunkCaught(chunks);
+        parallelFor(0, chunks, chunks, [&](int first, int last) {
+            for (int c = first; c < last; c++) {
+                int begin = (int)((int64_t)frontier.size() * c / chunks);
+                int end = (int)((int64_t)frontier.size() * (c + 1) / chunks);
+                spreadFireChunk(burning, frontier.data() + begin, end - begin, iterationKey, chunkCaught[c]);
+            }
+        });
+        std::vector<int> caught;
+        for (auto& chunk : chunkCaught) {
+            caught.insert(caught.end(), chunk.begin(), chunk.end());
+        }
+        std::sort(caught.begin(), caught.end());
+        caught.erase(std::unique(caught.begin(), caught.end()), caught.end());
 
-    std::vector<std::vector<int>> newBurned(rows, std::vector<int>(cols, 0));
+        for (int cell : caught) {
+            burning[cell] = iteration;
+            if (_terrainType[cell / cols][cell % cols] == FOREST) {
+                _terrainType[cell / cols][cell % cols] = GRASSLAND;
+            }
+        }
+
+        std::vector<int> next;
+        for (int cell : frontier) {
+            if (canSpreadFrom(burning, cell)) { next.push_back(cell); }
+        }
+        for (int cell : caught) {
+            int i = cell / cols;
+            int j = cell % cols;
+            if (i >= 1 && i < rows - 1 && j >= 1 && j < cols - 1 && canSpreadFrom(burning, cell)) { next.push_back(cell); }
+        }
+        frontier.swap(next);
+    }
+
+    //combined with current burned (only touched cells, and never the map edge)
+    for (auto& cell : burning) {
+        int i = cell.first / cols;
+        int j = cell.first % cols;
+        if (i >= 1 && i < rows - 1 && j >= 1 && j < cols - 1) {
+            _burned[cell.first] += cell.second;
+        }
+    }
+}
+
+// cells the given frontier cells set alight this step (may contain duplicates)
+void SLTerrain::spreadFireChunk(const std::unordered_map<int, int>& burning, const int* cells, int count, uint64_t iterationKey, std::vector<int>& caught) {
+    int cols = getCols();
+    for (int c = 0; c < count; c++) {
+        int cell = cells[c];
+        int i = cell / cols;
+        int j = cell % cols;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dx == 0 && dy == 0) continue; // skip self
+                int neighbour = cell + dy * cols + dx;
+                if (burning.count(neighbour) > 0) { continue; }
+                TerrainType type = _terrainType[i + dy][j + dx];
+                if (type != GRASSLAND && type != FOREST && type != VALLEY) { continue; }
+                // one draw per (batch, iteration, cell, neighbour)
+                uint64_t draw = SLCounterRng::combine(iterationKey, (uint64_t)cell * 9 + (dy + 1) * 3 + (dx + 1));
+                if (_rng.getFloat(RNG_WILDFIRE_BATCH, draw, 0, 1) < 0.1 * (0.2 + (_terrainType[i][j] == GRASSLAND))) {
+                    caught.push_back(neighbour);
+                }
+            }
+        }
+    }
+}
+
+void SLTerrain::wildfire(int x, int y, int iterations) {
+    int rows = getRows();
+    int cols = getCols();
 
     // avoid edges
     if (x <= iterations) { x = iterations + 1; }
@@ -653,49 +1743,378 @@ void SLTerrain::wildfire(int x, int y, int iterations) {
     if (y <= iterations) { y = iterations + 1; }
     else if (y > rows - iterations - 1) { y = rows - iterations - 2; }
 
-    newBurned[y][x] = 1;
+    // cells this fire has burned (cell index -> iteration it caught) and the ones still able to spread
+    std::unordered_map<int, int> newBurned;
+    std::vector<int> frontier;
+    newBurned[y * cols + x] = 1;
+    frontier.push_back(y * cols + x);
+    int fire = _wildfireCount++;
 
-    for (int i = 0; i < iterations; i++) {//should really be spreading step by step instead of cylcing whole matrix
-        wildfireIteration(newBurned, i + 1);
+    for (int i = 0; i < iterations && frontier.size() > 0; i++) {
+        wildfireIteration(newBurned, frontier, i + 1, fire);
     }
 
-    //combined with current burned
-    for (int i = 1; i < rows - 1; i++) {
-        for (int j = 1; j < cols - 1; j++) {
-            _burned[i][j] += newBurned[i][j];
+    //combined with current burned (only touched cells, and never the map edge)
+    for (auto& cell : newBurned) {
+        int i = cell.first / cols;
+        int j = cell.first % cols;
+        if (i >= 1 && i < rows - 1 && j >= 1 && j < cols - 1) {
+            _burned[cell.first] += cell.second;
         }
     }
 }
 
-// recursive wildfire spread (should really be spreading step by step instead of cylcing whole matrix)
-void SLTerrain::wildfireIteration(StdVec2Di& newBurned, int iteration) {
+// one step of the fire's spread, visiting only the frontier
+// cells are visited in row order and a cell that catches further along the same pass spreads in
+// this iteration too (so the result matches scanning the whole map in place)
+void SLTerrain::wildfireIteration(std::unordered_map<int, int>& newBurned, std::vector<int>& frontier, int iteration, int fire) {
     int rows = getRows();
     int cols = getCols();
+    uint64_t fireKey = SLCounterRng::combine(fire, iteration);
+
+    std::priority_queue<int, std::vector<int>, std::greater<int>> toVisit(frontier.begin(), frontier.end());
+    frontier.clear();
+
+    while (!toVisit.empty()) {
+        int cell = toVisit.top();
+        toVisit.pop();
+        int i = cell / cols;
+        int j = cell % cols;
+        if (i < 1 || i >= rows - 1 || j < 1 || j >= cols - 1) {
+            continue; // edges can burn but don't spread
+        }
 
-    for (int i = 1; i < rows - 1; i++) {
-        for (int j = 1; j < cols - 1; j++) {
-            if (newBurned[i][j] < 1) {
-                continue;
-            }
-            for (int dy = -1; dy <= 1; dy++) {
-                for (int dx = -1; dx <= 1; dx++) {
-                    if (dx == 0 && dy == 0) continue; // skip self
-                    if (newBurned[i + dy][j + dx] > 0) { continue; }
-                    //already know in bounds becuase of iteration check
-                    if (_terrainType[i + dy][j + dx] != GRASSLAND
-                        && _terrainType[i + dy][j + dx] != FOREST
-                        && _terrainType[i + dy][j + dx] != VALLEY) {
-                        //|| flowAccumulation[j + dx][i + dy] > 20) {//rivers should be covered by this
-                        continue;
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                if (dx == 0 && dy == 0) continue; // skip self
+                int neighbour = cell + dy * cols + dx;
+                if (newBurned.count(neighbour) > 0) { continue; }
+                if (_terrainType[i + dy][j + dx] != GRASSLAND
+                    && _terrainType[i + dy][j + dx] != FOREST
+                    && _terrainType[i + dy][j + dx] != VALLEY) {
+                    //|| flowAccumulation[j + dx][i + dy] > 20) {//rivers should be covered by this
+                    continue;
+                }
+                // one draw per (fire, iteration, cell, neighbour)
+                uint64_t draw = SLCounterRng::combine(fireKey, ((uint64_t)i * cols + j) * 9 + (dy + 1) * 3 + (dx + 1));
+                if (_rng.getFloat(RNG_WILDFIRE_SPREAD, draw, 0, 1) < 0.1 * (0.2 + (_terrainType[i][j] == GRASSLAND))) {
+                    newBurned[neighbour] = iteration;
+                    if (_terrainType[i + dy][j + dx] == FOREST) {
+                        _terrainType[i + dy][j + dx] = GRASSLAND;
+                    }
+                    if (neighbour > cell) {
+                        toVisit.push(neighbour); // still ahead in this pass
+                    }
+                    else {
+                        frontier.push_back(neighbour);
                     }
-                    if (SLRng::getFloat(0, 1) < 0.1 * (0.2 + (_terrainType[i][j] == GRASSLAND))) {
-                        newBurned[i + dy][j + dx] += iteration;
-                        if (_terrainType[i + dy][j + dx] == FOREST) {
-                            _terrainType[i + dy][j + dx] = GRASSLAND;
-                        }
+                }
+            }
+        }
+
+        if (canSpreadFrom(newBurned, cell)) {
+            frontier.push_back(cell);
+        }
+    }
+}
+
+// burning cells with no unburned, flammable neighbours can never spread again
+bool SLTerrain::canSpreadFrom(const std::unordered_map<int, int>& newBurned, int cell) {
+    int cols = getCols();
+    int i = cell / cols;
+    int j = cell % cols;
+    for (int dy = -1; dy <= 1; dy++) {
+        for (int dx = -1; dx <= 1; dx++) {
+            if (dx == 0 && dy == 0) continue;
+            TerrainType type = _terrainType[i + dy][j + dx];
+            if ((type == GRASSLAND || type == FOREST || type == VALLEY) && newBurned.count(cell + dy * cols + dx) == 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------
+// SLTerrainView
+
+bool SLTerrainView::open(std::string path, bool verifyChecksums) {
+    close();
+    if (!_file.open(path)) {
+        return false;
+    }
+    _reader.setVerifyChecksums(verifyChecksums);
+    if (!_reader.open(_file.data(), _file.size())) {
+        _file.close();
+        return false;
+    }
+    _info = SLTerrain::SaveInfo();
+    std::string bytes;
+    if (_reader.has("terrainInfo") && _reader.readBlob("terrainInfo", bytes) && bytes.size() == sizeof(_info)) {
+        std::memcpy(&_info, bytes.data(), sizeof(_info));
+    }
+    else {
+        SLGridView<float> height = getLayer<float>("height");
+        _info.rows = height.rows;
+        _info.cols = height.cols;
+    }
+    return true;
+}
+
+void SLTerrainView::close() {
+    _reader = SLContainerReader();
+    _decoded.clear();
+    _file.close();
+    _info = SLTerrain::SaveInfo();
+}
+
+bool SLTerrainView::load(SLTerrain& terrain) {
+    if (!isOpen()) {
+        printf("::::ERROR:::: SLTerrainView-> load with no file open\n");
+        return false;
+    }
+    return terrain.load(_reader);
+}
+
+bool SLTerrainView::load(SLTerrain& terrain, const std::vector<std::string>& layers, SLContainer::Rect rect) {
+    if (!isOpen()) {
+        printf("::::ERROR:::: SLTerrainView-> load with no file open\n");
+        return false;
+    }
+    return terrain.load(_reader, layers, rect);
+}
+
+//---------------------------------------------------------------------------------------------------
+// SLTerrainHistory
+
+static const std::string DELTA_PREFIX = "delta."; // grids stored as differences from the previous year
+
+bool SLTerrainHistory::open(std::string directory, int keyframeEvery) {
+    std::error_code error;
+    std::filesystem::create_directories(directory, error);
+    if (error) {
+        printf("::::ERROR:::: SLTerrainHistory-> could not create %s\n", directory.c_str());
+        return false;
+    }
+    _directory = directory;
+    _keyframeEvery = std::max(1, keyframeEvery);
+    _sinceKeyframe = 0;
+    _keyframeYear = -1;
+    _previousYear = -1;
+    _previous.clear(); // so the next record starts with a keyframe
+    _loadedYear = -1;
+    _loaded.clear();
+    return true;
+}
+
+std::string SLTerrainHistory::getPath(int year, bool keyframe) {
+    return _directory + "/year" + std::to_string(year) + (keyframe ? ".slt" : ".sltd");
+}
+
+bool SLTerrainHistory::writeContainer(const std::string& path, int threads, const std::function<bool(SLContainerWriter&)>& write) {
+    std::ofstream fout(path, std::ios::binary);
+    if (!fout.is_open()) {
+        printf("::::ERROR:::: SLTerrainHistory-> could not open %s\n", path.c_str());
+        return false;
+    }
+    SLContainerWriter out(fout);
+    out.setCompression(true); // never lossy, the next delta is against the exact bits
+    out.setThreads(threads);
+    return write(out) && out.finish();
+}
+
+bool SLTerrainHistory::record(SLTerrain& terrain) {
+    int year = terrain.getYear();
+    if (_directory.empty()) {
+        printf("::::ERROR:::: SLTerrainHistory-> record before open\n");
+        return false;
+    }
+    if (!_previous.empty() && year <= _previousYear) {
+        printf("::::ERROR:::: SLTerrainHistory-> year %d recorded after year %d\n", year, _previousYear);
+        return false;
+    }
+    _loadedYear = -1; // files may be replaced
+    _loaded.clear();
+
+    SLTerrain::SaveParams raw;
+    raw.compress = false;
+    std::ostringstream mem;
+    if (!terrain.save(mem, raw)) {
+        return false;
+    }
+    std::string current = mem.str();
+    SLContainerReader now;
+    now.setVerifyChecksums(false); // just written
+    now.open(current.data(), current.size());
+    int threads = terrain.getPipelineParams().threads;
+
+    bool keyframe = _previous.empty() || _sinceKeyframe + 1 >= _keyframeEvery;
+    bool ok = false;
+    if (keyframe) {
+        ok = writeContainer(getPath(year, true), threads, [&](SLContainerWriter& out) { return out.copyEntries(now); });
+    }
+    else {
+        SLContainerReader before;
+        before.setVerifyChecksums(false);
+        before.open(_previous.data(), _previous.size());
+        ok = writeContainer(getPath(year, false), threads, [&](SLContainerWriter& out) {
+            DeltaInfo info = { year, _previousYear, _keyframeYear };
+            bool written = out.writeBlob("deltaInfo", &info, sizeof(info));
+            std::vector<char> grid, old;
+            std::string blob;
+            for (auto& entry : now.getEntries()) {
+                if (entry.elementType == 0) { // params and lists, small enough to keep whole
+                    written = written && now.readBlob(entry.name, blob) && out.writeBlob(entry.name, blob);
+                    continue;
+                }
+                const SLContainer::Entry* was = before.find(entry.name);
+                written = written && now.readGridBytes(entry.name, grid);
+                if (was && was->elementType == entry.elementType && was->rows == entry.rows && was->cols == entry.cols) {
+                    written = written && before.readGridBytes(entry.name, old);
+                    if (written) {
+                        SLContainer::subtractGrid(entry.elementType, old.data(), grid.data(), (size_t)entry.rows * entry.cols);
                     }
+                    uint32_t deltaType = (SLContainer::KIND_SIGNED << 8) | (entry.elementType & 0xFF);
+                    written = written && out.writeGridBytes(DELTA_PREFIX + entry.name, deltaType, entry.rows, entry.cols, grid.data(), entry.bandRows);
+                }
+                else { // new or resized, whole
+                    written = written && out.writeGridBytes(entry.name, entry.elementType, entry.rows, entry.cols, grid.data(), entry.bandRows);
                 }
             }
+            return written;
+        });
+    }
+    if (!ok) {
+        printf("::::ERROR:::: SLTerrainHistory-> could not record year %d\n", year);
+        return false;
+    }
+    // a year recorded before (e.g. by an earlier run in this directory) as the other kind of file
+    // would shadow this one or break the chain through it
+    std::error_code error;
+    std::filesystem::remove(getPath(year, !keyframe), error);
+
+    if (keyframe) {
+        _keyframeYear = year;
+        _sinceKeyframe = 0;
+    }
+    else {
+        _sinceKeyframe++;
+    }
+    _previous.swap(current);
+    _previousYear = year;
+    return true;
+}
+
+bool SLTerrainHistory::load(int year, SLTerrain& terrain) {
+    int threads = terrain.getPipelineParams().threads;
+
+    // walk back to a keyframe (or the year loaded last), then apply the deltas forwards. every
+    // delta on the way has to name the next one back and the same keyframe, so files left over
+    // from a different recording aren't mixed in
+    std::vector<DeltaInfo> chain;
+    int y = year;
+    while (y != _loadedYear && !std::filesystem::exists(getPath(y, true))) {
+        std::ifstream fin(getPath(y, false), std::ios::binary);
+        SLContainerReader in;
+        std::string bytes;
+        DeltaInfo info;
+        if (!fin.is_open() || !in.open(fin) || !in.readBlob("deltaInfo", bytes) || bytes.size() != sizeof(info)) {
+            printf("::::ERROR:::: SLTerrainHistory-> year %d is not recorded (or its delta is damaged)\n", y);
+            return false;
+        }
+        std::memcpy(&info, bytes.data(), sizeof(info));
+        bool sameKeyframe = chain.empty() || info.keyframeYear == chain.back().keyframeYear;
+        if (info.year != y || info.previousYear >= y || info.keyframeYear > info.previousYear || !sameKeyframe) {
+            printf("::::ERROR:::: SLTerrainHistory-> delta for year %d is damaged or from a different recording\n", y);
+            return false;
+        }
+        chain.push_back(info);
+        y = info.previousYear;
+    }
+    int keyframeYear = y == _loadedYear ? _loadedKeyframeYear : y;
+    if (!chain.empty() && chain.back().keyframeYear != keyframeYear) {
+        printf("::::ERROR:::: SLTerrainHistory-> year %d was recorded against keyframe %d, but the files lead to %d\n",
+            year, chain.back().keyframeYear, keyframeYear);
+        return false;
+    }
+
+    std::string state;
+    if (y == _loadedYear) {
+        state = _loaded;
+    }
+    else { // the keyframe, decoded into memory
+        std::ifstream fin(getPath(y, true), std::ios::binary);
+        SLContainerReader in;
+        in.setThreads(threads);
+        std::ostringstream mem;
+        SLContainerWriter out(mem);
+        if (!in.open(fin) || !out.copyEntries(in) || !out.finish()) {
+            printf("::::ERROR:::: SLTerrainHistory-> could not read keyframe %d\n", y);
+            return false;
+        }
+        state = mem.str();
+    }
+
+    for (auto it = chain.rbegin(); it != chain.rend(); ++it) {
+        std::ifstream fin(getPath(it->year, false), std::ios::binary);
+        SLContainerReader delta, before;
+        delta.setThreads(threads);
+        before.setVerifyChecksums(false);
+        std::ostringstream mem;
+        SLContainerWriter out(mem);
+        bool ok = delta.open(fin) && before.open(state.data(), state.size());
+        std::vector<char> grid, old;
+        std::string blob;
+        for (size_t e = 0; ok && e < delta.getEntries().size(); e++) {
+            const SLContainer::Entry& entry = delta.getEntries()[e];
+            std::string name = entry.name;
+            if (name == "deltaInfo") { continue; }
+            if (name.compare(0, DELTA_PREFIX.size(), DELTA_PREFIX) == 0) {
+                name = name.substr(DELTA_PREFIX.size());
+                const SLContainer::Entry* was = before.find(name);
+                ok = was && was->rows == entry.rows && was->cols == entry.cols && (was->elementType & 0xFF) == (entry.elementType & 0xFF)
+                    && delta.readGridBytes(entry.name, grid) && before.readGridBytes(name, old);
+                if (ok) {
+                    SLContainer::addDelta(was->elementType, old.data(), grid.data(), (size_t)entry.rows * entry.cols);
+                }
+                ok = ok && out.writeGridBytes(name, was->elementType, entry.rows, entry.cols, grid.data(), entry.bandRows);
+            }
+            else if (entry.elementType != 0) {
+                ok = delta.readGridBytes(name, grid) && out.writeGridBytes(name, entry.elementType, entry.rows, entry.cols, grid.data(), entry.bandRows);
+            }
+            else {
+                ok = delta.readBlob(name, blob) && out.writeBlob(name, blob);
+            }
+        }
+        if (!ok || !out.finish()) {
+            printf("::::ERROR:::: SLTerrainHistory-> could not apply the delta for year %d\n", it->year);
+            return false;
+        }
+        state = mem.str();
+    }
+
+    SLContainerReader in;
+    in.setVerifyChecksums(false);
+    if (!in.open(state.data(), state.size()) || !terrain.load(in)) {
+        return false;
+    }
+    _loaded.swap(state);
+    _loadedYear = year;
+    _loadedKeyframeYear = keyframeYear;
+    return true;
+}
+
+std::vector<int> SLTerrainHistory::getYears() {
+    std::vector<int> years;
+    std::error_code error;
+    for (auto& file : std::filesystem::directory_iterator(_directory, error)) {
+        std::string name = file.path().filename().string();
+        std::string ext = file.path().extension().string();
+        if (name.compare(0, 4, "year") == 0 && (ext == ".slt" || ext == ".sltd")) {
+            years.push_back(std::atoi(name.c_str() + 4));
         }
     }
-}
\ No newline at end of file
+    std::sort(years.begin(), years.end());
+    years.erase(std::unique(years.begin(), years.end()), years.end());
+    return years;
+}
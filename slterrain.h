@@ -4,6 +4,11 @@
 #include <algorithm>
 #include <cmath>
 #include <string>
+#include <future>
+#include <chrono>
+#include <memory>
+#include <atomic>
+#include <functional>
 #include "utils/slMath.h"
 #include "slhydrology.h"
 using namespace SLMath;
@@ -21,6 +26,9 @@ using namespace SLMath;
 // this class uses those techniques along with standard game dev
 // techniques like fractional brownian motion (layered Perlin noise),
 // with basic terrain types, resources and cellular automata for wildfires.
+// 
+// All generation state (rng, noise, params, layers) is owned by the instance, so separate
+// SLTerrain objects can generate on separate threads and give the same maps as serial runs.
 class SLTerrain {
 public:
 	struct FBMParams {
@@ -47,6 +55,50 @@ public:
 		bool addResources = false;
 		int USPEDminBlur = 8; //minimum rnd blur radius for USPED erosion(used to avoid artifacts)
 		int USPEDmaxBlur = 30; //maximum rnd blur radius for USPED erosion
+		int wildfiresPerYear = 4; //random fires lit each processYear (all spread together)
+		int wildfireIterations = 6; //spread steps per fire
+
+		// optional early stop of the initial erosion once the landscape stops changing
+		// (age then becomes the maximum, see getErosionIterationsUsed)
+		bool useConvergence = false;
+		float convergenceRmsHeight = 0.025; //RMS height change per iteration
+		float convergenceD8Fraction = 0.05; //fraction of cells whose D8 direction changed
+		float convergenceChannelDrift = 0.03; //relative change in the number of channel cells
+		int convergenceChannelFlow = 100; //flow accumulation above which a cell counts as channel
+		int convergenceWindow = 3; //consecutive iterations under all thresholds before stopping
+	};
+
+	// per-iteration change metrics for the erosion convergence check
+	struct ErosionMetrics {
+		float rmsHeightChange = 0;
+		int d8Changes = 0;
+		int channelCells = 0;
+		float channelDrift = 0;
+	};
+
+	// how often (in years) each stage of processYear runs, stages that are skipped keep their
+	// last outputs. e.g. riversAndLakesInterval = 4 refreshes the fills, strahler order and
+	// channels every 4th year while erosion keeps running every year on the stale channels
+	// classification always waits for fresh rivers and lakes (flats in the filled D8 are the lakes)
+	struct PipelineParams {
+		int wildfireInterval = 1;
+		int erosionInterval = 1;
+		int riversAndLakesInterval = 1;
+		int classifyInterval = 1;
+		// run the rivers and lakes analysis on a height snapshot in the background while the next
+		// year's erosion runs, so erosion and classification use results a year behind
+		bool overlapRiversAndLakes = false;
+		int stepBandRows = 64; // rows per unit for the per-cell stages when stepping (see step)
+		bool publishSnapshots = false; // publish a TerrainSnapshot at the end of every year
+		int threads = 1; // for the stages that can split work across threads (e.g. batched wildfires)
+	};
+
+	// saves compress every layer with a codec suited to it (see SLContainer::Codec), lossless unless
+	// floatTolerance > 0, which lets the float layers (heights, slope, ...) be off by up to that much
+	// for much smaller files. checkpoints compress too but always keep floats exact
+	struct SaveParams {
+		bool compress = true;
+		float floatTolerance = 0;
 	};
 	
 	// designed with a tile-based city-building or 4x game in mind
@@ -66,17 +118,146 @@ public:
 		URANIUM
 	};
 
+	// terrain classification is a table of rules checked in order, the first rule whose
+	// conditions all hold sets the cell's type (cells no rule matches become GRASSLAND)
+	// see defaultClassifierRules for the built-in table and loadClassifierRules for the text format
+	enum ClassifierFeature {
+		FEATURE_HEIGHT,
+		FEATURE_RIDGE_HEIGHT, // height + 10 / flow accumulation (integer division), so dry ridges read higher
+		FEATURE_SLOPE,
+		FEATURE_FLOW,
+		FEATURE_BLURRED_FLOW,
+		FEATURE_BURNED, // burn iteration, 0 if not burned this year
+		FEATURE_CHANNEL, // 1 or 0
+		FEATURE_FLAT, // 1 where the D8 direction is 0 (lakes and pits)
+		FEATURE_FOREST, // 1 if the cell is forest before this classification
+		FEATURE_RANDOM, // per-cell draw in [0, 1) from the counter rng
+		FEATURE_COUNT
+	};
+	struct ClassifierRule {
+		TerrainType type = GRASSLAND;
+		bool keepCurrent = false; // leave the cell's type as it is instead of setting type
+		float minValue[FEATURE_COUNT]; // a feature matches if minValue < feature < maxValue
+		float maxValue[FEATURE_COUNT];
+		ClassifierRule(TerrainType type = GRASSLAND, bool keepCurrent = false) : type(type), keepCurrent(keepCurrent) {
+			for (int f = 0; f < FEATURE_COUNT; f++) {
+				minValue[f] = -INFINITY;
+				maxValue[f] = INFINITY;
+			}
+		}
+		ClassifierRule& greater(ClassifierFeature f, float value) { minValue[f] = value; return *this; }
+		ClassifierRule& less(ClassifierFeature f, float value) { maxValue[f] = value; return *this; }
+		bool uses(int f) const { return minValue[f] != -INFINITY || maxValue[f] != INFINITY; }
+	};
+
+	// progress of newMap, passed to the progress callback after each step
+	enum GenerationStage { STAGE_EROSION, STAGE_CHANNELS, STAGE_YEARS, STAGE_DONE };
+	struct GenerationProgress {
+		GenerationStage stage;
+		const char* stageName;
+		int iteration; // steps finished in this stage
+		int total; // steps in this stage (erosion can stop early if useConvergence is set)
+		double elapsedSeconds; // since newMap (or resume) started
+	};
+	typedef std::function<void(const GenerationProgress&)> ProgressCallback;
+
+	// read-only copy of the main layers at the end of a year, see getSnapshot
+	struct TerrainSnapshot {
+		int year = 0;
+		StdVec2Df height;
+		StdVec2Df heightFilled;
+		StdVec2Df slope;
+		StdVec2Di flowDirection;
+		std::vector<std::vector<uint64_t>> flowAccumulation;
+		std::vector<std::vector<bool>> isChannel;
+		std::vector<std::vector<TerrainType>> terrainTypes;
+		std::unordered_map<int, int> burned; // cell index (i * cols + j) -> burn iteration
+	};
+
+	// stages for the counter-based rng, one per kind of draw
+	// (numbered after SLHydrology's stages so the two never share a stream)
+	enum RngStage {
+		RNG_OFFSETS = 100,
+		RNG_USPED_BLUR,
+		RNG_HEIGHT_ADJUST,
+		RNG_FOREST,
+		RNG_WILDFIRE_IGNITION,
+		RNG_WILDFIRE_SPREAD,
+		RNG_RESOURCE_IRON,
+		RNG_RESOURCE_COAL,
+		RNG_RESOURCE_URANIUM,
+		RNG_RESOURCE_BOG_IRON,
+		RNG_RESOURCE_STONE,
+		RNG_WILDFIRE_BATCH
+	};
+
 	// main methods
 	void setup(); // only necessary if not using newMap (e.g. using load or manually passing in heightmap)
 
 	// for map generation using FBM and USPED erosion model
 	void newMap() { newMap(_fbm, _ter, _hydro.getErosionParams()); }
 	void newMap(FBMParams fbmParams, TerrainParams terrainParams, SLHydrology::ErosionParams erosionParams);
+
+	// newMap on a worker thread, for a fresh SLTerrain with this one's pipeline, checkpoint and
+	// progress callback settings (the callback is called on the worker thread)
+	// get() waits and returns nullptr if cancelled. Dropping the last copy of the handle also
+	// waits for the worker, so cancel first if the result isn't wanted
+	struct GenerationHandle {
+		std::shared_future<std::shared_ptr<SLTerrain>> result;
+		std::shared_ptr<std::atomic<bool>> cancelFlag;
+		void cancel() { if (cancelFlag) { *cancelFlag = true; } }
+		bool isReady() { return result.valid() && result.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+		std::shared_ptr<SLTerrain> get() { return result.get(); }
+	};
+	GenerationHandle newMapAsync(FBMParams fbmParams, TerrainParams terrainParams, SLHydrology::ErosionParams erosionParams);
+
+	// without a callback, progress is printed
+	void setProgressCallback(ProgressCallback callback) { _progressCallback = callback; }
+	// checked between stages and row bands, a cancelled newMap returns early with the map unfinished
+	void setCancelFlag(std::shared_ptr<std::atomic<bool>> cancelFlag) { _cancelFlag = cancelFlag; }
+	bool isCancelled() { return _cancelFlag && *_cancelFlag; }
 	void processYear(int year);
 	void processYearFast();
 	void processRiversAndLakes();
-	void save(std::ofstream& fout);
-	void load(std::ifstream& fin);
+	void refreshStaleStages(); // runs any stage the pipeline skipped this year (e.g. before output)
+
+	// cooperative version of processYear for calling from a game loop. beginYear starts the next
+	// year on a working copy and step runs it in small units (stages, or row bands of the per-cell
+	// stages) until the time budget is spent. step returns true when the year is done and swapped
+	// in. Until then the getters keep returning the previous year. (step calls beginYear if needed,
+	// inside the budget.) The working copy costs a copy of every layer, made by the first units
+	void beginYear();
+	bool step(int64_t budgetMicroseconds);
+	bool isYearInProgress() { return _working != nullptr; }
+
+	// safe to call from other threads (e.g. render or AI) while the simulation runs:
+	// returns the last published snapshot, which never changes once published
+	// (nullptr until the first one, see PipelineParams::publishSnapshots)
+	std::shared_ptr<const TerrainSnapshot> getSnapshot() const { return std::atomic_load(&_snapshots.current); }
+	void publishSnapshot(); // done automatically at the end of each year if publishSnapshots is set
+	// saves are an SLContainer (utils/slcontainer.h), load also reads the older raw format
+	struct SaveInfo { int rows = 0; int cols = 0; int year = 0; int seed = 0; }; // "terrainInfo" in saves
+	bool save(std::string path);
+	bool load(std::string path);
+	bool save(std::ofstream& fout);
+	bool save(std::ostream& out, const SaveParams& params); // e.g. into memory, leaves the stream open
+	bool load(std::ifstream& fin);
+	bool load(SLContainerReader& in); // from an open container, e.g. SLTerrainView's mapped file
+	// partial load, e.g. just terrain types for a viewport: only the named entries are read
+	// ("terrainType", SLHydrology::getLayerName(...), "burned", "deposits.iron"...), all if empty,
+	// plus the heights, which size the map. with a rect only the row bands it touches are read and
+	// the terrain becomes rect sized, its (0, 0) at the rect's corner (deposits and burned cells outside
+	// are dropped). layers not read stay empty, derived ones are rebuilt from the heights if their
+	// getters are used. container saves only
+	bool load(std::string path, const std::vector<std::string>& layers, SLContainer::Rect rect = SLContainer::Rect());
+	bool load(SLContainerReader& in, const std::vector<std::string>& layers, SLContainer::Rect rect = SLContainer::Rect());
+
+	// checkpoints hold the complete generation state (params, rng, year, all layers, deposits and
+	// how far newMap got), so resume continues exactly as if the run had never stopped
+	void setCheckpointing(std::string path, int everyYears) { _checkpointPath = path; _checkpointEvery = everyYears; }
+	bool saveCheckpoint(std::string path);
+	bool loadCheckpoint(std::string path);
+	bool resume(std::string path); // loadCheckpoint, then finish newMap if it was interrupted
 
 	// terrain generation
 	StdVec2Df FBMGenerator(FBMParams fbmParams, int rows, int cols); //TODO--generalize to SLMath??
@@ -89,23 +270,47 @@ public:
 	// allows objects using terrain to cause forest fires
 	void wildfire(int x, int y, int iterations);
 	void rndWildfire(int iterations);
+	void rndWildfires(int fires, int iterations); // a batch of random fires spreading together
+
+	// classification rules, see ClassifierRule
+	static std::vector<ClassifierRule> defaultClassifierRules();
+	void setClassifierRules(std::vector<ClassifierRule> rules) { _classifierRules = rules; }
+	std::vector<ClassifierRule> getClassifierRules() { return _classifierRules; }
+	bool loadClassifierRules(std::string path);
+
+	// resource deposits, resource is one of IRON, COAL, STONE, BOG_IRON or URANIUM
+	// the queries use a spatial index that leaves out deposits under standing water (kept up to
+	// date each time terrain types are calculated)
+	const std::vector<SLPoint>& getDeposits(TerrainType resource); // all, including flooded ones
+	const SLPointIndex& getDepositIndex(TerrainType resource);
+	std::vector<SLPoint> nearestDeposits(TerrainType resource, int x, int y, int k) { return getDepositIndex(resource).nearest({ x, y }, k); }
+	std::vector<SLPoint> depositsWithinRadius(TerrainType resource, int x, int y, float radius) { return getDepositIndex(resource).withinRadius({ x, y }, radius); }
+	std::vector<SLPoint> depositsWithinRect(TerrainType resource, int x0, int y0, int x1, int y1) { return getDepositIndex(resource).withinRect(x0, y0, x1, y1); }
 
 	// setters
 	void setFBMParams(FBMParams params) { _fbm = params; }
 	void setTerrainParams(TerrainParams ter) { _ter = ter; }
+	void setPipelineParams(PipelineParams pipeline) { _pipeline = pipeline; }
+	void setSaveParams(SaveParams save) { _save = save; }
 	SLHydrology::ErosionParams getErosionParams() { return _hydro.getErosionParams(); }
 	
 	// getters
 	int getCols() { return _hydro.getCols(); }
 	int getRows() { return _hydro.getRows(); }
-	int getBurned(int x, int y) { return _burned[y][x]; }
-	StdVec2Di& getBurned() { return _burned; }
+	int getYear() { return _year; } // simulated years (erosion iterations) since newMap
+	int getErosionIterationsUsed() { return _erosionIterationsUsed; } // initial erosion iterations run by newMap
+	ErosionMetrics getLastErosionMetrics() { return _metrics; }
+	int getBurned(int x, int y) { return burnedAt(y * getCols() + x); }
+	StdVec2Di getBurned(); // dense [y][x] copy, for exporting
+	const std::unordered_map<int, int>& getBurnedCells() { return _burned; }
 	std::vector<std::vector<TerrainType>>& getTerrainTypes() { return _terrainType; }
 	FBMParams getFBMParams() { return _fbm; }
 	SLHydrology& getHydro() { return _hydro; }
 
 	// params
 	TerrainParams getTerrainParams() { return _ter; }
+	PipelineParams getPipelineParams() { return _pipeline; }
+	SaveParams getSaveParams() { return _save; }
 	void setErosionParams(SLHydrology::ErosionParams ero) { _hydro.setErosionParams(ero); }
 
 	std::string getTerrainTypeName(TerrainType type) {
@@ -131,10 +336,102 @@ private:
 	// parameters
 	FBMParams _fbm;
 	TerrainParams _ter;
+	PipelineParams _pipeline;
+	SaveParams _save;
 	SLHydrology _hydro; // for erosion processing using USPED model
 
+	// rng keyed by (seed, year, stage, cell) so per-cell draws don't depend on loop order
+	SLCounterRng _rng;
+	int _year = 0;
+	int _wildfireCount = 0; // fires started this year, used to key each fire's draws
+	void advanceYear();
+
+	// stage cadence (see PipelineParams)
+	int _riversYear = -1; // year processRiversAndLakes last ran
+	int _classifyYear = -1; // year calculateTerrainTypes last ran
+	bool _classifyPending = false; // classification due but waiting for fresh rivers and lakes
+	bool stageDue(int interval) { return interval <= 1 || _year % interval == 0; }
+
+	// newMap progress, so generation can be resumed from a checkpoint
+	enum GenerationPhase { GEN_EROSION, GEN_CHANNELS, GEN_YEARS, GEN_DONE };
+	int _genPhase = GEN_DONE;
+	int _genIteration = 0;
+	void runGeneration();
+
+	// progress and cancellation
+	ProgressCallback _progressCallback;
+	std::shared_ptr<std::atomic<bool>> _cancelFlag;
+	std::chrono::steady_clock::time_point _genStart;
+	void reportProgress(GenerationStage stage, int iteration, int total);
+
+	// processYear as resumable units (see step)
+	enum StepStage {
+		STEP_WILDFIRE,
+		STEP_SLOPE,
+		STEP_DIRECTION,
+		STEP_ASPECT,
+		STEP_FLOW,
+		STEP_USPED,
+		STEP_USPED_ADJUST,
+		STEP_HEIGHTS,
+		STEP_RIVERS,
+		STEP_CLASSIFY,
+		STEP_DONE
+	};
+	int _stepStage = STEP_DONE;
+	int _stepRow = 0; // next row band, or next unit of the rivers and lakes chain
+	std::shared_ptr<SLTerrain> _working; // the year being stepped
+	int _copyUnit = 0; // next layer copied into _working before its year can start
+	static const int COPY_UNITS = SLHydrology::LAYER_COUNT + 3;
+	void copyUnit(int unit);
+	bool stepUnit();
+	static bool riversAndLakesUnit(SLHydrology& hydro, int unit);
+	double _sumSquaredChange = 0; // for the RMS height change across height adjustment bands
+	void adjustHeightsBand(int rowStart, int rowEnd);
+	std::vector<ClassifierRule> _classifierRules = defaultClassifierRules();
+	void prepareClassify(); // brings the classifier's input layers up to date before the (const) bands
+	void classifyBand(int rowStart, int rowEnd);
+	void classifyDeposits();
+
+	// published snapshots belong to this object and aren't copied or moved with the rest of the
+	// state, so step() can swap a finished year in while other threads load snapshots
+	struct SnapshotSlot {
+		std::shared_ptr<TerrainSnapshot> current; // only accessed with atomic_load/store
+		std::shared_ptr<TerrainSnapshot> spare; // the one before, reused once readers let go of it
+		SnapshotSlot() {}
+		SnapshotSlot(const SnapshotSlot&) {}
+		SnapshotSlot& operator=(const SnapshotSlot&) { return *this; }
+	};
+	SnapshotSlot _snapshots;
+
+	// checkpointing
+	std::string _checkpointPath;
+	int _checkpointEvery = 0; // years, 0 for off
+	int _lastCheckpointYear = -1;
+
+	// background rivers and lakes analysis (overlapRiversAndLakes)
+	std::shared_future<std::shared_ptr<SLHydrology>> _riversJob;
+	int _riversJobYear = -1; // year the snapshot was taken
+	static void analyseRiversAndLakes(SLHydrology& hydro);
+	void launchRiversAndLakes();
+	void joinRiversAndLakes();
+	void dropPendingWork();
+
+	// erosion convergence tracking
+	ErosionMetrics _metrics;
+	int _erosionIterationsUsed = 0;
+	int _convergedIterations = 0;
+	StdVec2Di _prevFlowDirection;
+	bool updateConvergence();
+
 	// all matrices are [y][x] for consistency with i, j notation (i.e i = y and x = j)
-	StdVec2Di _burned; // number represents burn iteration
+	// this year's burned cells only (few burn, so kept sparse): cell index (i * cols + j) -> burn iteration
+	std::unordered_map<int, int> _burned;
+	int burnedAt(int cell) const { auto it = _burned.find(cell); return it == _burned.end() ? 0 : it->second; }
+	struct BurnedCell { int cell; int iteration; }; // for saving
+	std::vector<BurnedCell> getBurnedList();
+	bool setBurnedList(const std::vector<BurnedCell>& cells);
+	bool loadLegacy(std::ifstream& fin);
 	std::vector<std::vector<TerrainType>> _terrainType;
 
 	// resources
@@ -143,6 +440,9 @@ private:
 	std::vector<SLPoint> _bogIronDeposits;
 	std::vector<SLPoint> _stoneDeposits;
 	std::vector<SLPoint> _uraniumDeposits;
+	SLPointIndex _depositIndex[URANIUM - IRON + 1]; // by resource - IRON, deposits not under standing water
+	std::vector<SLPoint>& depositList(TerrainType resource);
+	void rebuildDepositIndex();
 
 	// custom Cfactor (cover factor) for each terrain type
 	// used in SLHydrology for calculating erosion/deposition
@@ -183,6 +483,92 @@ private:
 		_Cfactor = C;
 	}
 	
-	void wildfireIteration(StdVec2Di& newBurned, int iteration);
+	void wildfireIteration(std::unordered_map<int, int>& newBurned, std::vector<int>& frontier, int iteration, int fire);
+	bool canSpreadFrom(const std::unordered_map<int, int>& newBurned, int cell);
+	void spreadFireChunk(const std::unordered_map<int, int>& burning, const int* cells, int count, uint64_t iterationKey, std::vector<int>& caught);
+};
+
+// read-only access to a saved terrain without loading it: the file is memory mapped and layers are
+// viewed in place, so opening a save costs the table of contents and whatever layers are looked at.
+// load() copies everything into an SLTerrain when a map needs to be simulated or changed
+// (or copy() a single layer's view)
+class SLTerrainView {
+public:
+	bool open(std::string path, bool verifyChecksums = true);
+	void close();
+	bool isOpen() { return _file.isOpen(); }
+
+	int getRows() { return _info.rows; }
+	int getCols() { return _info.cols; }
+	int getYear() { return _info.year; }
+	int getSeed() { return _info.seed; }
+
+	// empty view if the layer isn't in the save. compressed layers can't be viewed in place, so
+	// they're decoded on first use and the view points at that copy (kept until close)
+	template <typename T>
+	SLGridView<T> getLayer(const std::string& name) {
+		SLGridView<T> view = _reader.viewGrid<T>(name);
+		const SLContainer::Entry* entry = _reader.find(name);
+		if (!view.empty() || !entry || entry->elementType != SLContainer::elementTypeOf<T>() || entry->rows == 0) {
+			return view;
+		}
+		std::shared_ptr<void>& cached = _decoded[name];
+		if (!cached) {
+			auto flat = std::make_shared<std::vector<T>>();
+			int rows, cols;
+			if (!_reader.readGridFlat(name, *flat, rows, cols)) {
+				return view;
+			}
+			cached = flat;
+		}
+		view.data = static_cast<std::vector<T>*>(cached.get())->data();
+		view.rows = entry->rows;
+		view.cols = entry->cols;
+		return view;
+	}
+	SLGridView<float> getHeightMap() { return getLayer<float>("height"); }
+	SLGridView<float> getSlope() { return getLayer<float>("slope"); }
+	SLGridView<int> getFlowDirection() { return getLayer<int>("flowDirection"); }
+	SLGridView<uint64_t> getFlowAccumulation() { return getLayer<uint64_t>("flowAccumulation"); }
+	SLGridView<SLTerrain::TerrainType> getTerrainTypes() { return getLayer<SLTerrain::TerrainType>("terrainType"); }
+	SLContainerReader& getReader() { return _reader; }
+
+	bool load(SLTerrain& terrain);
+	bool load(SLTerrain& terrain, const std::vector<std::string>& layers, SLContainer::Rect rect = SLContainer::Rect());
+
+private:
+	SLMappedFile _file;
+	SLContainerReader _reader;
+	SLTerrain::SaveInfo _info;
+	std::unordered_map<std::string, std::shared_ptr<void>> _decoded; // compressed layers, by name
 };
 
+// per-year history for replays without a full save per year: every keyframeEvery recorded years
+// (and the first) is a keyframe, a normal lossless save. the years between store each layer as its
+// difference from the year before (see SLContainer::subtractGrid), so unchanged cells are zeros the
+// save codecs all but drop and small height changes are small numbers. files are
+// <directory>/year<N>.slt (keyframes, loadable as saves on their own) and year<N>.sltd (deltas)
+class SLTerrainHistory {
+public:
+	bool open(std::string directory, int keyframeEvery = 10); // existing years are kept
+	bool record(SLTerrain& terrain); // the terrain as it is now, as year terrain.getYear()
+	// rebuilds a year from the keyframe before it and the deltas since (loaded like SLTerrain::load)
+	bool load(int year, SLTerrain& terrain);
+	std::vector<int> getYears(); // recorded years, oldest first
+
+private:
+	std::string _directory;
+	int _keyframeEvery = 10;
+	int _sinceKeyframe = 0;
+	int _keyframeYear = -1;
+	int _previousYear = -1;
+	std::string _previous; // the last recorded year as an uncompressed save, what the next delta is against
+
+	int _loadedYear = -1; // the last year load rebuilt, so stepping through a replay only applies one delta
+	int _loadedKeyframeYear = -1;
+	std::string _loaded;
+
+	struct DeltaInfo { int year; int previousYear; int keyframeYear; }; // "deltaInfo" in deltas
+	std::string getPath(int year, bool keyframe);
+	bool writeContainer(const std::string& path, int threads, const std::function<bool(SLContainerWriter&)>& write);
+};
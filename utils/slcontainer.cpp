@@ -0,0 +1,811 @@
+#include "slcontainer.h"
+#include "slmath.h"
+#include <cmath>
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// standard (zlib/png) crc32
+static std::vector<uint32_t> buildCrcTable() {
+    std::vector<uint32_t> table(256);
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+uint32_t SLContainer::crc32(const void* data, size_t size, uint32_t crc) {
+    static const std::vector<uint32_t> table = buildCrcTable(); // thread-safe static init
+
+    const uint8_t* bytes = (const uint8_t*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ bytes[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+SLContainer::Rect SLContainer::clip(Rect rect, int rows, int cols) {
+    if (rect.whole()) {
+        return { 0, 0, cols, rows };
+    }
+    Rect clipped;
+    clipped.x = std::max(0, rect.x);
+    clipped.y = std::max(0, rect.y);
+    clipped.width = std::max(0, std::min(cols, rect.x + rect.width) - clipped.x);
+    clipped.height = std::max(0, std::min(rows, rect.y + rect.height) - clipped.y);
+    return clipped;
+}
+
+//---------------------------------------------------------------------------------------------------
+// codecs
+
+namespace {
+    // elements as 64 bit integers (sign extended for signed kinds) and back
+    int64_t loadInt(const char* p, int size, bool isSigned) {
+        uint64_t v = 0;
+        std::memcpy(&v, p, size);
+        if (isSigned && size < 8 && (v >> (size * 8 - 1)) & 1) {
+            v |= ~0ull << (size * 8);
+        }
+        return (int64_t)v;
+    }
+    void storeInt(char* p, int size, int64_t v) {
+        uint64_t u = (uint64_t)v;
+        std::memcpy(p, &u, size);
+    }
+
+    // float bits mapped so integer order matches float order (nearby floats -> nearby integers)
+    uint64_t orderedFromFloat(uint64_t bits, int size) {
+        uint64_t sign = 1ull << (size * 8 - 1);
+        uint64_t mask = size == 8 ? ~0ull : (1ull << (size * 8)) - 1;
+        return (bits & sign) ? ~bits & mask : bits | sign;
+    }
+    uint64_t floatFromOrdered(uint64_t ordered, int size) {
+        uint64_t sign = 1ull << (size * 8 - 1);
+        uint64_t mask = size == 8 ? ~0ull : (1ull << (size * 8)) - 1;
+        return (ordered & sign) ? ordered & ~sign : ~ordered & mask;
+    }
+
+    uint64_t zigzag(int64_t v) { return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63); }
+    int64_t unzigzag(uint64_t v) { return (int64_t)(v >> 1) ^ -(int64_t)(v & 1); }
+
+    void putVarint(std::vector<char>& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back((char)v);
+    }
+    bool getVarint(const char*& p, const char* end, uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64 && p < end; shift += 7) {
+            uint8_t byte = (uint8_t)*p++;
+            v |= (uint64_t)(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) { return true; }
+        }
+        return false;
+    }
+
+    // left + up - upleft, inside the chunk only (wrapping arithmetic, it only has to be reversible)
+    void predict(std::vector<int64_t>& values, int rows, int cols, std::vector<uint64_t>& residuals) {
+        residuals.resize(values.size());
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                size_t k = (size_t)i * cols + j;
+                uint64_t guess = 0;
+                if (j > 0) { guess += (uint64_t)values[k - 1]; }
+                if (i > 0) { guess += (uint64_t)values[k - cols]; }
+                if (i > 0 && j > 0) { guess -= (uint64_t)values[k - cols - 1]; }
+                residuals[k] = zigzag((int64_t)((uint64_t)values[k] - guess));
+            }
+        }
+    }
+    void unpredict(const std::vector<uint64_t>& residuals, int rows, int cols, std::vector<int64_t>& values) {
+        values.resize(residuals.size());
+        for (int i = 0; i < rows; i++) {
+            for (int j = 0; j < cols; j++) {
+                size_t k = (size_t)i * cols + j;
+                uint64_t guess = 0;
+                if (j > 0) { guess += (uint64_t)values[k - 1]; }
+                if (i > 0) { guess += (uint64_t)values[k - cols]; }
+                if (i > 0 && j > 0) { guess -= (uint64_t)values[k - cols - 1]; }
+                values[k] = (int64_t)(guess + (uint64_t)unzigzag(residuals[k]));
+            }
+        }
+    }
+
+    // blocks of 64: a width byte, then each residual in that many bits (lowest bit first)
+    // values go in at most 32 bits at a time so the 64 bit accumulator never overflows
+    void packResiduals(const std::vector<uint64_t>& residuals, std::vector<char>& out) {
+        for (size_t block = 0; block < residuals.size(); block += 64) {
+            size_t end = std::min(residuals.size(), block + 64);
+            uint64_t all = 0;
+            for (size_t k = block; k < end; k++) { all |= residuals[k]; }
+            int width = 0;
+            while (width < 64 && (all >> width)) { width++; }
+            out.push_back((char)width);
+
+            uint64_t acc = 0;
+            int bits = 0;
+            for (size_t k = block; k < end; k++) {
+                for (int done = 0; done < width; done += 32) {
+                    int piece = std::min(32, width - done);
+                    acc |= ((residuals[k] >> done) & ((1ull << piece) - 1)) << bits;
+                    bits += piece;
+                    while (bits >= 8) {
+                        out.push_back((char)acc);
+                        acc >>= 8;
+                        bits -= 8;
+                    }
+                }
+            }
+            if (bits > 0) { out.push_back((char)acc); }
+        }
+    }
+    bool unpackResiduals(const char*& p, const char* end, size_t count, std::vector<uint64_t>& residuals) {
+        residuals.assign(count, 0);
+        for (size_t block = 0; block < count; block += 64) {
+            size_t blockEnd = std::min(count, block + 64);
+            if (p >= end) { return false; }
+            int width = (uint8_t)*p++;
+            if (width > 64 || (size_t)(end - p) < ((blockEnd - block) * width + 7) / 8) { return false; }
+
+            uint64_t acc = 0;
+            int bits = 0;
+            for (size_t k = block; k < blockEnd; k++) {
+                for (int done = 0; done < width; done += 32) {
+                    int piece = std::min(32, width - done);
+                    while (bits < piece) {
+                        acc |= (uint64_t)(uint8_t)*p++ << bits;
+                        bits += 8;
+                    }
+                    residuals[k] |= (acc & ((1ull << piece) - 1)) << done;
+                    acc >>= piece;
+                    bits -= piece;
+                }
+            }
+        }
+        return true;
+    }
+
+    void encodeRuns(const std::vector<int64_t>& values, std::vector<char>& out) {
+        for (size_t k = 0; k < values.size();) {
+            size_t run = 1;
+            while (k + run < values.size() && values[k + run] == values[k]) { run++; }
+            putVarint(out, zigzag(values[k]));
+            putVarint(out, run);
+            k += run;
+        }
+    }
+    bool decodeRuns(const char* p, const char* end, std::vector<int64_t>& values) {
+        size_t k = 0;
+        while (p < end) {
+            uint64_t value, run;
+            if (!getVarint(p, end, value) || !getVarint(p, end, run) || run > values.size() - k) { return false; }
+            std::fill(values.begin() + k, values.begin() + k + run, unzigzag(value));
+            k += run;
+        }
+        return k == values.size();
+    }
+}
+
+void SLContainer::subtractGrid(uint32_t elementType, const char* old, char* grid, size_t count) {
+    int size = elementType & 0xFF;
+    bool isFloat = (elementType >> 8) == KIND_FLOAT;
+    for (size_t k = 0; k < count; k++) {
+        uint64_t a = (uint64_t)loadInt(grid + k * size, size, false);
+        uint64_t b = (uint64_t)loadInt(old + k * size, size, false);
+        if (isFloat) {
+            a = orderedFromFloat(a, size);
+            b = orderedFromFloat(b, size);
+        }
+        storeInt(grid + k * size, size, (int64_t)(a - b));
+    }
+}
+
+void SLContainer::addDelta(uint32_t elementType, const char* old, char* delta, size_t count) {
+    int size = elementType & 0xFF;
+    bool isFloat = (elementType >> 8) == KIND_FLOAT;
+    uint64_t mask = size == 8 ? ~0ull : (1ull << (size * 8)) - 1;
+    for (size_t k = 0; k < count; k++) {
+        uint64_t b = (uint64_t)loadInt(old + k * size, size, false);
+        uint64_t d = (uint64_t)loadInt(delta + k * size, size, false);
+        uint64_t a = ((isFloat ? orderedFromFloat(b, size) : b) + d) & mask;
+        storeInt(delta + k * size, size, (int64_t)(isFloat ? floatFromOrdered(a, size) : a));
+    }
+}
+
+uint32_t SLContainer::encodeChunk(uint32_t elementType, int rows, int cols, const char* raw, std::vector<char>& out, float tolerance) {
+    out.clear();
+    int size = elementType & 0xFF;
+    int kind = elementType >> 8;
+    size_t count = (size_t)rows * cols;
+    if (count == 0 || size == 0 || size > 8 || kind == KIND_BYTES || (kind == KIND_FLOAT && size != 4 && size != 8)) {
+        return CODEC_RAW;
+    }
+
+    uint32_t codec = CODEC_RAW;
+    std::vector<int64_t> values(count);
+    std::vector<uint64_t> residuals;
+    if (kind == KIND_FLOAT) {
+        // quantized only if every cell really comes back within tolerance (not for nan, inf or huge values)
+        double step = 2.0 * tolerance;
+        bool quantized = tolerance > 0;
+        for (size_t k = 0; k < count && quantized; k++) {
+            double v = size == 4 ? (double)((const float*)raw)[k] : ((const double*)raw)[k];
+            double q = std::round(v / step);
+            double back = size == 4 ? (double)(float)(q * step) : q * step;
+            quantized = std::isfinite(v) && std::fabs(q) < 4.5e15 && std::fabs(back - v) <= tolerance;
+            values[k] = quantized ? (int64_t)q : 0;
+        }
+        if (quantized) {
+            codec = CODEC_FLOAT_QUANTIZED;
+            out.resize(sizeof(double));
+            std::memcpy(out.data(), &step, sizeof(double));
+        }
+        else {
+            codec = CODEC_FLOAT_DELTA;
+            for (size_t k = 0; k < count; k++) {
+                values[k] = (int64_t)orderedFromFloat((uint64_t)loadInt(raw + k * size, size, false), size);
+            }
+        }
+        predict(values, rows, cols, residuals);
+        packResiduals(residuals, out);
+    }
+    else {
+        for (size_t k = 0; k < count; k++) {
+            values[k] = loadInt(raw + k * size, size, kind == KIND_SIGNED);
+        }
+        // categories compress best as runs, smooth integers (flow, counts) as residuals and
+        // patternless ones (deltas) as they are
+        std::vector<char> runs, bits;
+        encodeRuns(values, runs);
+        residuals.resize(count);
+        for (size_t k = 0; k < count; k++) {
+            residuals[k] = zigzag(values[k]);
+        }
+        packResiduals(residuals, bits);
+        predict(values, rows, cols, residuals);
+        packResiduals(residuals, out);
+        codec = CODEC_INT_DELTA;
+        if (runs.size() < out.size()) {
+            out.swap(runs);
+            codec = CODEC_RLE;
+        }
+        if (bits.size() < out.size()) {
+            out.swap(bits);
+            codec = CODEC_BITS;
+        }
+    }
+
+    if (out.size() >= count * size) {
+        out.clear();
+        return CODEC_RAW;
+    }
+    return codec;
+}
+
+bool SLContainer::decodeChunk(uint32_t codec, uint32_t elementType, int rows, int cols, const char* data, size_t size, char* raw) {
+    int elementSize = elementType & 0xFF;
+    int kind = elementType >> 8;
+    size_t count = (size_t)rows * cols;
+    const char* end = data + size;
+    if (codec == CODEC_RAW) {
+        if (size != count * elementSize) { return false; }
+        if (size > 0) { std::memcpy(raw, data, size); }
+        return true;
+    }
+
+    if (elementSize == 0 || elementSize > 8 || (kind == KIND_FLOAT && elementSize != 4 && elementSize != 8)) {
+        return false;
+    }
+
+    std::vector<int64_t> values(count);
+    std::vector<uint64_t> residuals;
+    switch (codec) {
+    case CODEC_FLOAT_DELTA:
+    case CODEC_INT_DELTA:
+        if (!unpackResiduals(data, end, count, residuals)) { return false; }
+        unpredict(residuals, rows, cols, values);
+        break;
+    case CODEC_FLOAT_QUANTIZED: {
+        double step;
+        if (size < sizeof(double)) { return false; }
+        std::memcpy(&step, data, sizeof(double));
+        data += sizeof(double);
+        if (!unpackResiduals(data, end, count, residuals)) { return false; }
+        unpredict(residuals, rows, cols, values);
+        for (size_t k = 0; k < count; k++) {
+            double v = (double)values[k] * step;
+            if (elementSize == 4) { ((float*)raw)[k] = (float)v; }
+            else { ((double*)raw)[k] = v; }
+        }
+        return kind == KIND_FLOAT;
+    }
+    case CODEC_RLE:
+        if (!decodeRuns(data, end, values)) { return false; }
+        break;
+    case CODEC_BITS:
+        if (!unpackResiduals(data, end, count, residuals)) { return false; }
+        for (size_t k = 0; k < count; k++) {
+            values[k] = unzigzag(residuals[k]);
+        }
+        break;
+    default:
+        return false;
+    }
+
+    for (size_t k = 0; k < count; k++) {
+        int64_t v = codec == CODEC_FLOAT_DELTA ? (int64_t)floatFromOrdered((uint64_t)values[k], elementSize) : values[k];
+        storeInt(raw + k * elementSize, elementSize, v);
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// writer
+
+SLContainerWriter::SLContainerWriter(std::ostream& out) : _out(out) {
+    _base = out.tellp();
+    SLContainer::Header header = {}; // placeholder until finish
+    _out.write((const char*)&header, sizeof(header));
+}
+
+bool SLContainerWriter::beginEntry(const std::string& name, uint32_t elementType, int rows, int cols, int bandRows) {
+    if (_finished) {
+        printf("::::ERROR:::: SLContainerWriter-> %s added after finish\n", name.c_str());
+        return _good = false;
+    }
+    if (name.size() >= SLContainer::NAME_SIZE) {
+        printf("::::ERROR:::: SLContainerWriter-> entry name too long: %s\n", name.c_str());
+        return _good = false;
+    }
+
+    // pad so every entry starts aligned (lets a mapped file be read in place)
+    uint64_t pos = position();
+    uint64_t pad = (SLContainer::ALIGNMENT - pos % SLContainer::ALIGNMENT) % SLContainer::ALIGNMENT;
+    static const char zeros[SLContainer::ALIGNMENT] = {};
+    _out.write(zeros, pad);
+
+    SLContainer::Entry entry = {};
+    std::memcpy(entry.name, name.data(), name.size());
+    entry.elementType = elementType;
+    entry.rows = rows;
+    entry.cols = cols;
+    entry.bandRows = std::max(1, bandRows);
+    entry.firstChunk = (uint32_t)_chunks.size();
+    entry.chunkCount = 0;
+    _entries.push_back(entry);
+    return true;
+}
+
+// chunks of an entry follow each other with no padding, so raw grids are one contiguous block
+bool SLContainerWriter::writeChunk(const void* data, size_t size, size_t rawSize, uint32_t codec) {
+    SLContainer::Chunk chunk = {};
+    chunk.offset = position();
+    chunk.size = size;
+    chunk.rawSize = codec == SLContainer::CODEC_RAW ? size : rawSize;
+    chunk.crc = SLContainer::crc32(data, size);
+    chunk.codec = codec;
+    _out.write((const char*)data, size);
+    _chunks.push_back(chunk);
+    _entries.back().chunkCount++;
+    return _out.good();
+}
+
+bool SLContainerWriter::writeBands(std::vector<std::vector<char>>& bands, int count, int cols) {
+    const SLContainer::Entry& entry = _entries.back();
+    std::vector<std::vector<char>> encoded(count);
+    std::vector<uint32_t> codecs(count, SLContainer::CODEC_RAW);
+    if (_compress) {
+        size_t rowBytes = (size_t)cols * (entry.elementType & 0xFF);
+        SLMath::parallelFor(0, count, _threads, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                int rows = rowBytes > 0 ? (int)(bands[k].size() / rowBytes) : 0;
+                codecs[k] = SLContainer::encodeChunk(entry.elementType, rows, cols, bands[k].data(), encoded[k], _tolerance);
+            }
+        });
+    }
+    for (int k = 0; k < count; k++) {
+        bool written = codecs[k] == SLContainer::CODEC_RAW ? writeChunk(bands[k].data(), bands[k].size())
+            : writeChunk(encoded[k].data(), encoded[k].size(), bands[k].size(), codecs[k]);
+        if (!written) { return _good = false; }
+    }
+    return true;
+}
+
+bool SLContainerWriter::writeGridBytes(const std::string& name, uint32_t elementType, int rows, int cols, const char* data, int bandRows) {
+    if (!beginEntry(name, elementType, rows, cols, bandRows)) { return false; }
+    size_t bandBytes = (size_t)_entries.back().bandRows * cols * (elementType & 0xFF);
+    size_t total = (size_t)rows * cols * (elementType & 0xFF);
+    int group = _compress ? _threads : 1;
+    std::vector<std::vector<char>> bands(group);
+    for (size_t offset = 0; offset < total;) {
+        int count = 0;
+        for (; count < group && offset < total; count++) {
+            size_t size = std::min(bandBytes, total - offset);
+            bands[count].assign(data + offset, data + offset + size);
+            offset += size;
+        }
+        if (!writeBands(bands, count, cols)) { return false; }
+    }
+    return true;
+}
+
+bool SLContainerWriter::copyEntries(SLContainerReader& in) {
+    std::vector<char> grid;
+    std::string blob;
+    for (auto& entry : in.getEntries()) {
+        bool ok = entry.elementType != 0
+            ? in.readGridBytes(entry.name, grid) && writeGridBytes(entry.name, entry.elementType, entry.rows, entry.cols, grid.data(), entry.bandRows)
+            : in.readBlob(entry.name, blob) && writeBlob(entry.name, blob);
+        if (!ok) { return false; }
+    }
+    return true;
+}
+
+bool SLContainerWriter::writeBlob(const std::string& name, const void* data, size_t size) {
+    if (!beginEntry(name, 0, 0, 0, 1)) { return false; }
+    return writeChunk(data, size);
+}
+
+bool SLContainerWriter::finish() {
+    if (_finished) { return good(); }
+    _finished = true;
+
+    SLContainer::Header header = {};
+    std::memcpy(header.magic, SLContainer::MAGIC, 4);
+    header.version = SLContainer::VERSION;
+    header.entryCount = (uint32_t)_entries.size();
+    header.chunkCount = (uint32_t)_chunks.size();
+    header.tocOffset = position();
+
+    // table of contents: entries then chunks
+    std::vector<char> toc(_entries.size() * sizeof(SLContainer::Entry) + _chunks.size() * sizeof(SLContainer::Chunk));
+    if (!_entries.empty()) {
+        std::memcpy(toc.data(), _entries.data(), _entries.size() * sizeof(SLContainer::Entry));
+    }
+    if (!_chunks.empty()) {
+        std::memcpy(toc.data() + _entries.size() * sizeof(SLContainer::Entry), _chunks.data(), _chunks.size() * sizeof(SLContainer::Chunk));
+    }
+    header.tocSize = toc.size();
+    header.tocCrc = SLContainer::crc32(toc.data(), toc.size());
+    _out.write(toc.data(), toc.size());
+
+    std::streamoff end = _out.tellp();
+    _out.seekp(_base);
+    _out.write((const char*)&header, sizeof(header));
+    _out.seekp(end);
+    _out.flush();
+    if (!good()) {
+        printf("::::ERROR:::: SLContainerWriter-> write failed\n");
+        return false;
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// reader
+
+bool SLContainerReader::isContainer(std::istream& in) {
+    std::streamoff start = in.tellg();
+    char magic[4] = {};
+    in.read(magic, 4);
+    bool isContainer = in.gcount() == 4 && std::memcmp(magic, SLContainer::MAGIC, 4) == 0;
+    in.clear();
+    in.seekg(start);
+    return isContainer;
+}
+
+bool SLContainerReader::open(std::istream& in) {
+    _in = &in;
+    _data = nullptr;
+    _base = in.tellg();
+
+    SLContainer::Header header;
+    in.read((char*)&header, sizeof(header));
+    if (!in.good() || !checkHeader(header)) {
+        return false;
+    }
+    std::vector<char> toc(header.tocSize);
+    in.seekg(_base + (std::streamoff)header.tocOffset);
+    in.read(toc.data(), toc.size());
+    if (!in.good()) {
+        printf("::::ERROR:::: SLContainerReader-> table of contents is truncated\n");
+        return false;
+    }
+    return readTableOfContents(header, toc.data());
+}
+
+bool SLContainerReader::open(const char* data, size_t size) {
+    _in = nullptr;
+    _data = data;
+    _size = size;
+    _base = 0;
+
+    SLContainer::Header header = {};
+    if (data && size >= sizeof(header)) {
+        std::memcpy(&header, data, sizeof(header));
+    }
+    if (!checkHeader(header)) {
+        return false;
+    }
+    if (header.tocOffset > size || header.tocSize > size - header.tocOffset) {
+        printf("::::ERROR:::: SLContainerReader-> table of contents is truncated\n");
+        return false;
+    }
+    return readTableOfContents(header, data + header.tocOffset);
+}
+
+bool SLContainerReader::checkHeader(const SLContainer::Header& header) {
+    _entries.clear();
+    _chunks.clear();
+    if (std::memcmp(header.magic, SLContainer::MAGIC, 4) != 0) {
+        printf("::::ERROR:::: SLContainerReader-> not a container\n");
+        return false;
+    }
+    if (header.version > SLContainer::VERSION) {
+        printf("::::ERROR:::: SLContainerReader-> container version %u is newer than this reader (%u)\n", header.version, SLContainer::VERSION);
+        return false;
+    }
+    uint64_t expected = (uint64_t)header.entryCount * sizeof(SLContainer::Entry) + (uint64_t)header.chunkCount * sizeof(SLContainer::Chunk);
+    if (header.tocSize != expected) {
+        printf("::::ERROR:::: SLContainerReader-> bad table of contents size\n");
+        return false;
+    }
+    return true;
+}
+
+bool SLContainerReader::readTableOfContents(const SLContainer::Header& header, const char* toc) {
+    if (SLContainer::crc32(toc, header.tocSize) != header.tocCrc) {
+        printf("::::ERROR:::: SLContainerReader-> table of contents is damaged\n");
+        return false;
+    }
+
+    _entries.resize(header.entryCount);
+    _chunks.resize(header.chunkCount);
+    if (!_entries.empty()) {
+        std::memcpy(_entries.data(), toc, _entries.size() * sizeof(SLContainer::Entry));
+    }
+    if (!_chunks.empty()) {
+        std::memcpy(_chunks.data(), toc + _entries.size() * sizeof(SLContainer::Entry), _chunks.size() * sizeof(SLContainer::Chunk));
+    }
+    for (auto& entry : _entries) {
+        entry.name[SLContainer::NAME_SIZE - 1] = 0;
+        if ((uint64_t)entry.firstChunk + entry.chunkCount > _chunks.size()) {
+            printf("::::ERROR:::: SLContainerReader-> %s has chunks out of range\n", entry.name);
+            return false;
+        }
+    }
+    return true;
+}
+
+const SLContainer::Entry* SLContainerReader::find(const std::string& name) {
+    for (auto& entry : _entries) {
+        if (name == entry.name) {
+            return &entry;
+        }
+    }
+    return nullptr;
+}
+
+const char* SLContainerReader::readChunk(const SLContainer::Entry& entry, uint32_t chunkIndex, std::vector<char>& buffer, size_t& size) {
+    const SLContainer::Chunk& chunk = _chunks[entry.firstChunk + chunkIndex];
+    const char* bytes = nullptr;
+    if (_data) {
+        if (chunk.offset > _size || chunk.size > _size - chunk.offset) {
+            printf("::::ERROR:::: SLContainerReader-> %s is truncated\n", entry.name);
+            return nullptr;
+        }
+        bytes = _data + chunk.offset;
+    }
+    else {
+        buffer.resize(chunk.size);
+        _in->clear();
+        _in->seekg(_base + (std::streamoff)chunk.offset);
+        _in->read(buffer.data(), chunk.size);
+        if (!_in->good()) {
+            printf("::::ERROR:::: SLContainerReader-> %s is truncated\n", entry.name);
+            return nullptr;
+        }
+        static const char empty = 0;
+        bytes = chunk.size > 0 ? buffer.data() : &empty; // never null, null means failed
+    }
+
+    if (_verify && SLContainer::crc32(bytes, chunk.size) != chunk.crc) {
+        printf("::::ERROR:::: SLContainerReader-> %s chunk %u failed its crc check\n", entry.name, chunkIndex);
+        return nullptr;
+    }
+    size = chunk.size;
+    return bytes;
+}
+
+// start of an entry whose raw chunks follow each other with no gaps (how the writer lays them out)
+const char* SLContainerReader::contiguousData(const SLContainer::Entry& entry, size_t expectedSize) {
+    if (entry.chunkCount == 0) {
+        return nullptr;
+    }
+    const char* start = _data + _chunks[entry.firstChunk].offset;
+    size_t total = 0;
+    std::vector<char> unused;
+    for (uint32_t c = 0; c < entry.chunkCount; c++) {
+        const SLContainer::Chunk& chunk = _chunks[entry.firstChunk + c];
+        size_t size = 0;
+        if (chunk.codec != SLContainer::CODEC_RAW || _data + chunk.offset != start + total || !readChunk(entry, c, unused, size)) {
+            return nullptr;
+        }
+        total += size;
+    }
+    return total == expectedSize ? start : nullptr;
+}
+
+bool SLContainerReader::readBlob(const std::string& name, std::string& bytes) {
+    const SLContainer::Entry* entry = find(name);
+    if (!entry) {
+        printf("::::ERROR:::: SLContainerReader-> no entry %s\n", name.c_str());
+        return false;
+    }
+    bytes.clear();
+    std::vector<char> buffer;
+    for (uint32_t c = 0; c < entry->chunkCount; c++) {
+        if (_chunks[entry->firstChunk + c].codec != SLContainer::CODEC_RAW) {
+            printf("::::ERROR:::: SLContainerReader-> %s uses unknown codec %u\n", entry->name, _chunks[entry->firstChunk + c].codec);
+            return false;
+        }
+        size_t size = 0;
+        const char* chunk = readChunk(*entry, c, buffer, size);
+        if (!chunk) { return false; }
+        bytes.append(chunk, size);
+    }
+    return true;
+}
+
+bool SLContainerReader::readGridBytes(const std::string& name, std::vector<char>& flat) {
+    const SLContainer::Entry* entry = find(name);
+    if (!entry || entry->elementType == 0) {
+        printf("::::ERROR:::: SLContainerReader-> no %s grid\n", name.c_str());
+        return false;
+    }
+    size_t rowBytes = (size_t)entry->cols * (entry->elementType & 0xFF);
+    flat.resize(entry->rows * rowBytes);
+    return readBands(*entry, 0, entry->chunkCount, [&](int row, const char* band) {
+        std::memcpy(flat.data() + row * rowBytes, band, rowBytes);
+    });
+}
+
+bool SLContainerReader::readBands(const SLContainer::Entry& entry, uint32_t first, uint32_t last, const std::function<void(int, const char*)>& rowOut) {
+    size_t rowBytes = (size_t)entry.cols * (entry.elementType & 0xFF);
+    int group = _threads;
+    std::vector<std::vector<char>> buffers(group), decoded(group);
+    std::vector<const char*> stored(group), bands(group);
+    std::vector<size_t> sizes(group);
+    for (uint32_t c = first; c < last; c += group) {
+        int count = (int)std::min<uint32_t>(group, last - c);
+        // stored bytes are read in order (streams seek), then decoded in parallel
+        for (int k = 0; k < count; k++) {
+            stored[k] = readChunk(entry, c + k, buffers[k], sizes[k]);
+            if (!stored[k]) { return false; }
+        }
+        SLMath::parallelFor(0, count, _threads, [&](int begin, int end) {
+            for (int k = begin; k < end; k++) {
+                const SLContainer::Chunk& chunk = _chunks[entry.firstChunk + c + k];
+                int row = (c + k) * entry.bandRows;
+                int rows = std::max(0, std::min((int)entry.rows, row + entry.bandRows) - row);
+                bands[k] = nullptr;
+                if (chunk.rawSize != rows * rowBytes) { continue; }
+                if (chunk.codec == SLContainer::CODEC_RAW) {
+                    bands[k] = sizes[k] == chunk.rawSize ? stored[k] : nullptr;
+                    continue;
+                }
+                decoded[k].resize(chunk.rawSize);
+                if (SLContainer::decodeChunk(chunk.codec, entry.elementType, rows, entry.cols, stored[k], sizes[k], decoded[k].data())) {
+                    bands[k] = decoded[k].data();
+                }
+            }
+        });
+        for (int k = 0; k < count; k++) {
+            if (!bands[k]) {
+                printf("::::ERROR:::: SLContainerReader-> %s chunk %u could not be decoded (codec %u)\n", entry.name, c + k, _chunks[entry.firstChunk + c + k].codec);
+                return false;
+            }
+            int row = (c + k) * entry.bandRows;
+            int bandEnd = std::min((int)entry.rows, row + entry.bandRows);
+            for (int i = row; i < bandEnd; i++) {
+                rowOut(i, bands[k] + (size_t)(i - row) * rowBytes);
+            }
+        }
+    }
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// mapped files
+
+#ifdef _WIN32
+
+bool SLMappedFile::open(const std::string& path) {
+    close();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        printf("::::ERROR:::: SLMappedFile-> could not open %s\n", path.c_str());
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        printf("::::ERROR:::: SLMappedFile-> %s is empty\n", path.c_str());
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!data) {
+        printf("::::ERROR:::: SLMappedFile-> could not map %s\n", path.c_str());
+        if (mapping) { CloseHandle(mapping); }
+        CloseHandle(file);
+        return false;
+    }
+    _file = file;
+    _mapping = mapping;
+    _data = (const char*)data;
+    _size = (size_t)size.QuadPart;
+    return true;
+}
+
+void SLMappedFile::close() {
+    if (_data) { UnmapViewOfFile(_data); }
+    if (_mapping) { CloseHandle((HANDLE)_mapping); }
+    if (_file) { CloseHandle((HANDLE)_file); }
+    _data = nullptr;
+    _mapping = nullptr;
+    _file = nullptr;
+    _size = 0;
+}
+
+#else
+
+bool SLMappedFile::open(const std::string& path) {
+    close();
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        printf("::::ERROR:::: SLMappedFile-> could not open %s\n", path.c_str());
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size == 0) {
+        printf("::::ERROR:::: SLMappedFile-> %s is empty\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    void* data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED) {
+        printf("::::ERROR:::: SLMappedFile-> could not map %s\n", path.c_str());
+        ::close(fd);
+        return false;
+    }
+    _fd = fd;
+    _data = (const char*)data;
+    _size = (size_t)info.st_size;
+    return true;
+}
+
+void SLMappedFile::close() {
+    if (_data) { munmap((void*)_data, _size); }
+    if (_fd >= 0) { ::close(_fd); }
+    _data = nullptr;
+    _fd = -1;
+    _size = 0;
+}
+
+#endif
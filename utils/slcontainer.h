@@ -0,0 +1,339 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <cstdio>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <iostream>
+#include <type_traits>
+#include <functional>
+
+// SLContainer------------------------------------------------------------------------------------
+// Chunked binary container for named grids and blobs, used for terrain saves and checkpoints.
+//
+// Layout: a 64 byte header (magic, format version, where the table of contents is), then the
+// entries' data, each entry starting 64 byte aligned, then the table of contents.
+// The table of contents lists every entry by name with its element type, grid size and chunks.
+// Grids are split into chunks of bandRows rows, each with its own offset, size and CRC32, so a
+// reader can seek straight to any entry (or band of rows) and damage is caught per chunk.
+// Blobs (params, small state) are entries with no rows and a single chunk.
+// Unknown entries are skipped by readers, so new layers can be added without breaking old files.
+//
+// USAGE: SLContainerWriter out(fout); out.writeGrid("height", z); ... out.finish();
+//        SLContainerReader in; in.open(fin); in.readGrid("height", z);
+// Everything is little-endian raw memory, like the rest of the save code.
+// -----------------------------------------------------------------------------------------------
+
+namespace SLContainer {
+    static const char MAGIC[4] = { 'S', 'L', 'T', 'C' };
+    static const uint32_t VERSION = 1;
+    static const int ALIGNMENT = 64;
+    static const int NAME_SIZE = 48;
+
+    // element type codes: kind in the high byte, size in bytes in the low byte
+    enum ElementKind { KIND_BYTES = 0, KIND_FLOAT = 1, KIND_SIGNED = 2, KIND_UNSIGNED = 3 };
+    template <typename T>
+    uint32_t elementTypeOf() {
+        int kind = std::is_floating_point<T>::value ? KIND_FLOAT
+            : std::is_signed<typename std::conditional<std::is_enum<T>::value, std::underlying_type<T>, std::common_type<T>>::type::type>::value ? KIND_SIGNED
+            : KIND_UNSIGNED;
+        return (uint32_t)(kind << 8) | (uint32_t)sizeof(T);
+    }
+
+    // how a chunk's bytes are stored. the writer picks per chunk and keeps raw if nothing is smaller
+    // (the predictors only look inside the chunk, so chunks decode independently and in parallel)
+    enum Codec {
+        CODEC_RAW = 0,
+        CODEC_FLOAT_DELTA, // lossless floats: bits mapped to ordered integers, then like CODEC_INT_DELTA
+        CODEC_FLOAT_QUANTIZED, // floats rounded to a step (error <= tolerance), then like CODEC_INT_DELTA
+        CODEC_INT_DELTA, // integers: left + up - upleft prediction, zigzagged residuals bit packed
+        CODEC_RLE, // integers as (value, run length) varint pairs, for categories and D8
+        CODEC_BITS // integers zigzagged and bit packed as they are, for data with no spatial pattern (e.g. xor deltas)
+    };
+    // residuals are bit packed in blocks of 64 with one width byte per block, so a smooth patch
+    // costs a few bits per cell and a noisy one only widens its own block
+
+    // codec for a chunk of rows x cols elements, CODEC_RAW (and out left empty) if nothing beats raw
+    // tolerance > 0 allows CODEC_FLOAT_QUANTIZED for floats
+    uint32_t encodeChunk(uint32_t elementType, int rows, int cols, const char* raw, std::vector<char>& out, float tolerance = 0);
+    bool decodeChunk(uint32_t codec, uint32_t elementType, int rows, int cols, const char* data, size_t size, char* raw);
+
+#pragma pack(push, 1)
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t entryCount;
+        uint32_t chunkCount;
+        uint64_t tocOffset; // from the start of the container
+        uint64_t tocSize;
+        uint32_t tocCrc;
+        uint8_t reserved[ALIGNMENT - 36];
+    };
+    struct Chunk {
+        uint64_t offset; // from the start of the container
+        uint64_t size; // stored bytes
+        uint64_t rawSize; // bytes once decoded (the same for CODEC_RAW)
+        uint32_t crc; // of the stored bytes
+        uint32_t codec;
+    };
+    struct Entry {
+        char name[NAME_SIZE];
+        uint32_t elementType; // 0 for blobs
+        int32_t rows; // 0 for blobs
+        int32_t cols;
+        int32_t bandRows; // rows per chunk
+        uint32_t firstChunk; // index into the table of chunks
+        uint32_t chunkCount;
+    };
+#pragma pack(pop)
+
+    uint32_t crc32(const void* data, size_t size, uint32_t crc = 0);
+
+    // a rectangle of cells for partial reads, a zero width or height means the whole grid
+    struct Rect {
+        int x = 0;
+        int y = 0;
+        int width = 0;
+        int height = 0;
+        bool whole() const { return width <= 0 || height <= 0; }
+    };
+    Rect clip(Rect rect, int rows, int cols); // the part inside a rows x cols grid (whole -> all of it)
+
+    // cell by cell grid - old for two flat grids of the same element type, as signed integers of the
+    // element's size (floats by their ordered bits, so a small change is a small number wherever it is).
+    // lossless both ways, addDelta turns the delta back into the grid
+    void subtractGrid(uint32_t elementType, const char* old, char* grid, size_t count);
+    void addDelta(uint32_t elementType, const char* old, char* delta, size_t count);
+}
+
+// read-only [row][col] view of a grid stored somewhere else (e.g. a memory mapped save)
+template <typename T>
+struct SLGridView {
+    const T* data = nullptr;
+    int rows = 0;
+    int cols = 0;
+    const T* operator[](int row) const { return data + (size_t)row * cols; }
+    bool empty() const { return data == nullptr; }
+    // a private, writable copy (for when a viewed layer needs to change)
+    std::vector<std::vector<T>> copy() const {
+        std::vector<std::vector<T>> grid(rows);
+        for (int i = 0; i < rows; i++) {
+            grid[i].assign((*this)[i], (*this)[i] + cols);
+        }
+        return grid;
+    }
+};
+
+// a whole file mapped read-only into memory (mmap, or a file mapping on windows)
+class SLMappedFile {
+public:
+    SLMappedFile() {}
+    ~SLMappedFile() { close(); }
+    SLMappedFile(const SLMappedFile&) = delete;
+    SLMappedFile& operator=(const SLMappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const { return _data != nullptr; }
+    const char* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const char* _data = nullptr;
+    size_t _size = 0;
+#ifdef _WIN32
+    void* _file = nullptr;
+    void* _mapping = nullptr;
+#else
+    int _fd = -1;
+#endif
+};
+
+class SLContainerReader;
+
+class SLContainerWriter {
+public:
+    SLContainerWriter(std::ostream& out);
+
+    template <typename T>
+    bool writeGrid(const std::string& name, const std::vector<std::vector<T>>& grid, int bandRows = 64) {
+        int rows = (int)grid.size();
+        int cols = rows > 0 ? (int)grid[0].size() : 0; // unbuilt layers are empty
+        if (!beginEntry(name, SLContainer::elementTypeOf<T>(), rows, cols, bandRows)) { return false; }
+
+        // each band is copied into one buffer so it goes out in a single write with its crc
+        // (a group of bands at a time, so they can be encoded in parallel)
+        size_t rowBytes = (size_t)cols * sizeof(T);
+        int bandRowsUsed = _entries.back().bandRows;
+        int group = _compress ? _threads : 1;
+        std::vector<std::vector<char>> bands(group);
+        for (int row = 0; row < rows; row += bandRowsUsed * group) {
+            int count = 0;
+            for (; count < group && row + count * bandRowsUsed < rows; count++) {
+                int bandStart = row + count * bandRowsUsed;
+                int bandEnd = std::min(rows, bandStart + bandRowsUsed);
+                bands[count].resize((size_t)(bandEnd - bandStart) * rowBytes);
+                for (int i = bandStart; i < bandEnd; i++) {
+                    if ((int)grid[i].size() != cols) {
+                        printf("::::ERROR:::: SLContainerWriter-> %s is not rectangular\n", name.c_str());
+                        return _good = false;
+                    }
+                    std::memcpy(bands[count].data() + (size_t)(i - bandStart) * rowBytes, grid[i].data(), rowBytes);
+                }
+            }
+            if (!writeBands(bands, count, cols)) { return false; }
+        }
+        return true;
+    }
+
+    // a grid given as one flat [row * cols + col] buffer of elementType elements (e.g. copied from a reader)
+    bool writeGridBytes(const std::string& name, uint32_t elementType, int rows, int cols, const char* data, int bandRows = 64);
+    // every entry of another container, grids decoded and written again (so with this writer's compression)
+    bool copyEntries(SLContainerReader& in);
+
+    template <typename T>
+    bool writeVector(const std::string& name, const std::vector<T>& vector) {
+        return writeBlob(name, vector.data(), vector.size() * sizeof(T));
+    }
+    bool writeBlob(const std::string& name, const void* data, size_t size);
+    bool writeBlob(const std::string& name, const std::string& bytes) { return writeBlob(name, bytes.data(), bytes.size()); }
+
+    bool finish(); // writes the table of contents and the header, nothing can be added after
+    bool good() { return _good && _out.good(); }
+
+    // grids written after this are compressed (see SLContainer::Codec). tolerance > 0 lets float
+    // grids be stored with at most that much error. chunks are encoded on up to threads threads
+    void setCompression(bool compress, float tolerance = 0) { _compress = compress; _tolerance = tolerance; }
+    void setThreads(int threads) { _threads = std::max(1, threads); }
+
+private:
+    std::ostream& _out;
+    std::streamoff _base;
+    bool _good = true;
+    bool _finished = false;
+    std::vector<SLContainer::Entry> _entries;
+    std::vector<SLContainer::Chunk> _chunks;
+    bool _compress = false;
+    float _tolerance = 0;
+    int _threads = 1;
+
+    bool beginEntry(const std::string& name, uint32_t elementType, int rows, int cols, int bandRows);
+    bool writeChunk(const void* data, size_t size, size_t rawSize = 0, uint32_t codec = SLContainer::CODEC_RAW);
+    bool writeBands(std::vector<std::vector<char>>& bands, int count, int cols); // the next count chunks of the current grid
+    uint64_t position() { return (uint64_t)((std::streamoff)_out.tellp() - _base); }
+};
+
+class SLContainerReader {
+public:
+    static bool isContainer(std::istream& in); // checks the magic, leaves the stream where it was
+    bool open(std::istream& in); // reads and checks the header and table of contents
+    // reads straight from memory (e.g. an SLMappedFile), which must outlive the reader
+    bool open(const char* data, size_t size);
+    // on by default. checking means touching every byte, so a viewer that only looks at part of a
+    // mapped layer may want it off
+    void setVerifyChecksums(bool verify) { _verify = verify; }
+
+    bool has(const std::string& name) { return find(name) != nullptr; }
+    const SLContainer::Entry* find(const std::string& name);
+    const std::vector<SLContainer::Entry>& getEntries() { return _entries; }
+
+    // with a rect only the chunks (bands of rows) it touches are read, and grid is rect sized
+    template <typename T>
+    bool readGrid(const std::string& name, std::vector<std::vector<T>>& grid, SLContainer::Rect rect = SLContainer::Rect()) {
+        const SLContainer::Entry* entry = find(name);
+        if (!entry) {
+            printf("::::ERROR:::: SLContainerReader-> no entry %s\n", name.c_str());
+            return false;
+        }
+        if (entry->elementType != SLContainer::elementTypeOf<T>()) {
+            printf("::::ERROR:::: SLContainerReader-> %s has element type %x, expected %x\n", name.c_str(), entry->elementType, SLContainer::elementTypeOf<T>());
+            return false;
+        }
+
+        bool whole = rect.whole();
+        rect = SLContainer::clip(rect, entry->rows, entry->cols);
+        if (!whole && rect.whole()) {
+            printf("::::ERROR:::: SLContainerReader-> rect is outside %s\n", name.c_str());
+            return false;
+        }
+
+        grid.assign(rect.height, std::vector<T>(rect.width));
+        size_t rowBytes = (size_t)rect.width * sizeof(T);
+        size_t skip = (size_t)rect.x * sizeof(T);
+        uint32_t first = rect.y / entry->bandRows;
+        uint32_t last = std::min(entry->chunkCount, (uint32_t)((rect.y + rect.height + entry->bandRows - 1) / entry->bandRows));
+        return readBands(*entry, first, last, [&](int row, const char* band) {
+            if (row >= rect.y && row < rect.y + rect.height) {
+                std::memcpy(grid[row - rect.y].data(), band + skip, rowBytes);
+            }
+        });
+    }
+
+    // the whole grid into one flat [row * cols + col] buffer
+    template <typename T>
+    bool readGridFlat(const std::string& name, std::vector<T>& flat, int& rows, int& cols) {
+        const SLContainer::Entry* entry = find(name);
+        if (!entry || entry->elementType != SLContainer::elementTypeOf<T>()) {
+            printf("::::ERROR:::: SLContainerReader-> no %s grid of the expected type\n", name.c_str());
+            return false;
+        }
+        rows = entry->rows;
+        cols = entry->cols;
+        flat.resize((size_t)rows * cols);
+        size_t rowBytes = (size_t)cols * sizeof(T);
+        return readBands(*entry, 0, entry->chunkCount, [&](int row, const char* band) {
+            std::memcpy(flat.data() + (size_t)row * cols, band, rowBytes);
+        });
+    }
+
+    bool readGridBytes(const std::string& name, std::vector<char>& flat); // any element type, flat like readGridFlat
+
+    void setThreads(int threads) { _threads = std::max(1, threads); } // for decoding chunks
+
+    // points straight into the data, no copy. only for readers opened on memory, and only for
+    // uncompressed grids (an empty view otherwise, use readGrid then)
+    template <typename T>
+    SLGridView<T> viewGrid(const std::string& name) {
+        SLGridView<T> view;
+        const SLContainer::Entry* entry = find(name);
+        if (!entry || !_data || entry->elementType != SLContainer::elementTypeOf<T>()) {
+            return view;
+        }
+        const char* start = contiguousData(*entry, (size_t)entry->rows * entry->cols * sizeof(T));
+        if (start) {
+            view.data = (const T*)start;
+            view.rows = entry->rows;
+            view.cols = entry->cols;
+        }
+        return view;
+    }
+
+    template <typename T>
+    bool readVector(const std::string& name, std::vector<T>& vector) {
+        std::string bytes;
+        if (!readBlob(name, bytes)) { return false; }
+        vector.resize(bytes.size() / sizeof(T));
+        std::memcpy(vector.data(), bytes.data(), vector.size() * sizeof(T));
+        return true;
+    }
+    bool readBlob(const std::string& name, std::string& bytes);
+
+private:
+    std::istream* _in = nullptr; // one of _in or _data
+    std::streamoff _base = 0;
+    const char* _data = nullptr;
+    size_t _size = 0;
+    bool _verify = true;
+    int _threads = 1;
+    std::vector<SLContainer::Entry> _entries;
+    std::vector<SLContainer::Chunk> _chunks;
+
+    bool checkHeader(const SLContainer::Header& header);
+    bool readTableOfContents(const SLContainer::Header& header, const char* toc);
+    // the chunk's stored bytes, checked. from memory directly, or read into buffer from a stream
+    const char* readChunk(const SLContainer::Entry& entry, uint32_t chunk, std::vector<char>& buffer, size_t& size);
+    const char* contiguousData(const SLContainer::Entry& entry, size_t expectedSize);
+    // decodes chunks [first, last) of a grid and hands each row to rowOut(row, bytes)
+    bool readBands(const SLContainer::Entry& entry, uint32_t first, uint32_t last, const std::function<void(int, const char*)>& rowOut);
+};
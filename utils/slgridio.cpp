@@ -0,0 +1,759 @@
+#include "slgridio.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <type_traits>
+
+namespace {
+    const size_t CHUNK_BYTES = 4 << 20;
+
+    bool hostIsBigEndian() {
+        const uint16_t one = 1;
+        uint8_t first;
+        std::memcpy(&first, &one, 1);
+        return first == 0;
+    }
+
+    std::string lower(std::string s) {
+        for (char& c : s) {
+            c = (char)std::tolower((unsigned char)c);
+        }
+        return s;
+    }
+
+    size_t extensionDot(const std::string& path) {
+        size_t dot = path.find_last_of('.');
+        size_t slash = path.find_last_of("/\\");
+        if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) {
+            return std::string::npos;
+        }
+        return dot;
+    }
+    std::string extension(const std::string& path) {
+        size_t dot = extensionDot(path);
+        return dot == std::string::npos ? "" : lower(path.substr(dot + 1));
+    }
+    std::string withoutExtension(const std::string& path) {
+        return path.substr(0, extensionDot(path));
+    }
+
+    bool isSpace(char c) {
+        return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+    }
+
+    bool allocate(std::vector<std::vector<float>>& grid, int rows, int cols, const char* func) {
+        if (rows <= 0 || cols <= 0) {
+            printf("::::ERROR:::: %s-> bad grid size %d x %d\n", func, cols, rows);
+            return false;
+        }
+        grid.assign(rows, std::vector<float>(cols));
+        return true;
+    }
+
+    // while reading nodata cells are stored as NaN and the valid range is tracked; this turns them
+    // into their final height and fills in the mask
+    struct NoDataTracker {
+        float minValid = std::numeric_limits<float>::max();
+        int64_t count = 0;
+
+        // value already scaled
+        void row(float* z, int cols) {
+            for (int x = 0; x < cols; x++) {
+                if (std::isnan(z[x])) {
+                    count++;
+                } else {
+                    minValid = std::min(minValid, z[x]);
+                }
+            }
+        }
+
+        void finish(std::vector<std::vector<float>>& grid, const SLGridIO::ImportParams& params,
+            std::vector<std::vector<uint8_t>>* mask) const {
+            if (mask) {
+                mask->assign(grid.size(), std::vector<uint8_t>(grid.empty() ? 0 : grid[0].size(), 0));
+            }
+            if (count == 0) {
+                return;
+            }
+            float fill = params.noDataHeight;
+            if (params.fillNoDataWithMin && minValid != std::numeric_limits<float>::max()) {
+                fill = minValid;
+            }
+            for (size_t y = 0; y < grid.size(); y++) {
+                std::vector<float>& z = grid[y];
+                for (size_t x = 0; x < z.size(); x++) {
+                    if (std::isnan(z[x])) {
+                        z[x] = fill;
+                        if (mask) {
+                            (*mask)[y][x] = 1;
+                        }
+                    }
+                }
+            }
+        }
+    };
+
+    void scaleRow(float* z, int cols, const SLGridIO::ImportParams& params) {
+        if (params.scale == 1 && params.offset == 0) {
+            return;
+        }
+        for (int x = 0; x < cols; x++) {
+            z[x] = z[x] * params.scale + params.offset;
+        }
+    }
+
+    // one row of raw pixels to floats, nodata to NaN. float nodata is compared at the pixel's own
+    // precision, integers against the exact value (so -9999 never matches an unsigned pixel)
+    template <typename T>
+    void rawToFloat(const uint8_t* src, int cols, bool swap, bool checkNoData, double noData, float* z) {
+        const double nd = std::is_floating_point<T>::value ? (double)(T)noData : noData;
+        uint8_t b[sizeof(T)];
+        for (int x = 0; x < cols; x++) {
+            std::memcpy(b, src + x * sizeof(T), sizeof(T));
+            if (swap) {
+                std::reverse(b, b + sizeof(T));
+            }
+            T v;
+            std::memcpy(&v, b, sizeof(T));
+            z[x] = (checkNoData && (double)v == nd) ? NAN : (float)v;
+        }
+    }
+
+    // whitespace separated tokens over a file read in big chunks. a token is only handed out whole:
+    // when one runs into the end of the buffer the tail is moved to the front and the rest read in
+    class ChunkTokenizer {
+    public:
+        ChunkTokenizer(std::istream& in) : _in(in), _buffer(CHUNK_BYTES) {}
+
+        bool next(const char*& start, const char*& end) {
+            while (true) {
+                while (_pos < _end && isSpace(_buffer[_pos])) {
+                    _pos++;
+                }
+                size_t tokenEnd = _pos;
+                while (tokenEnd < _end && !isSpace(_buffer[tokenEnd])) {
+                    tokenEnd++;
+                }
+                if (tokenEnd < _end || (_eof && tokenEnd > _pos)) {
+                    start = _buffer.data() + _pos;
+                    end = _buffer.data() + tokenEnd;
+                    _pos = tokenEnd;
+                    return true;
+                }
+                if (_eof) {
+                    return false;
+                }
+                refill();
+            }
+        }
+
+    private:
+        std::istream& _in;
+        std::vector<char> _buffer;
+        size_t _pos = 0;
+        size_t _end = 0;
+        bool _eof = false;
+
+        void refill() {
+            size_t kept = _end - _pos;
+            if (kept == _buffer.size()) {
+                _buffer.resize(_buffer.size() * 2); // a token longer than the buffer, hardly happens
+            }
+            std::memmove(_buffer.data(), _buffer.data() + _pos, kept);
+            _pos = 0;
+            _end = kept;
+            _in.read(_buffer.data() + _end, _buffer.size() - _end);
+            _end += (size_t)_in.gcount();
+            if (_end < _buffer.size()) {
+                _eof = true;
+            }
+        }
+    };
+}
+
+const char* SLGridIO::parseNumber(const char* start, const char* end, double& value) {
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+
+    const char* p = start;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0; // significant digits kept in the mantissa
+    int exponent = 0;
+    bool any = false;
+    for (; p < end && *p >= '0' && *p <= '9'; p++) {
+        any = true;
+        if (digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits += mantissa != 0;
+        } else {
+            exponent++;
+        }
+    }
+    if (p < end && *p == '.') {
+        p++;
+        for (; p < end && *p >= '0' && *p <= '9'; p++) {
+            any = true;
+            if (digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                digits += mantissa != 0;
+                exponent--;
+            }
+        }
+    }
+    if (!any) {
+        return start;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* e = p + 1;
+        bool negativeExp = false;
+        if (e < end && (*e == '-' || *e == '+')) {
+            negativeExp = *e == '-';
+            e++;
+        }
+        if (e < end && *e >= '0' && *e <= '9') {
+            int exp = 0;
+            for (; e < end && *e >= '0' && *e <= '9'; e++) {
+                exp = std::min(exp * 10 + (*e - '0'), 100000);
+            }
+            exponent += negativeExp ? -exp : exp;
+            p = e;
+        }
+    }
+
+    // exact for the usual DEM values (mantissa and power of ten both exact doubles, one rounding);
+    // anything else goes to strtod so the result is always correctly rounded
+    if (mantissa < (1ull << 53) && exponent >= -22 && exponent <= 22) {
+        double v = (double)mantissa;
+        v = exponent < 0 ? v / powers[-exponent] : v * powers[exponent];
+        value = negative ? -v : v;
+    } else {
+        std::string text(start, p);
+        value = std::strtod(text.c_str(), nullptr);
+    }
+    return p;
+}
+
+//---------------------------------------------------------------------------------------------------
+// ESRI ASCII grid
+
+bool SLGridIO::loadAsciiGrid(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+    const ImportParams& params, std::vector<std::vector<uint8_t>>* noDataMask) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: SLGridIO::loadAsciiGrid-> could not open %s\n", path.c_str());
+        return false;
+    }
+    ChunkTokenizer tokens(fin);
+    info = GridInfo();
+
+    // header: key value pairs until the first token that is a number
+    const char* start;
+    const char* end;
+    bool centered = false;
+    bool haveToken = tokens.next(start, end);
+    while (haveToken) {
+        double v;
+        if (parseNumber(start, end, v) == end) {
+            break;
+        }
+        std::string key = lower(std::string(start, end));
+        if (!tokens.next(start, end) || parseNumber(start, end, v) != end) {
+            printf("::::ERROR:::: SLGridIO::loadAsciiGrid-> bad header value for %s in %s\n", key.c_str(), path.c_str());
+            return false;
+        }
+        if (key == "ncols") {
+            info.cols = (int)v;
+        } else if (key == "nrows") {
+            info.rows = (int)v;
+        } else if (key == "xllcorner" || key == "xllcenter") {
+            info.xllCorner = v;
+            centered = key == "xllcenter";
+        } else if (key == "yllcorner" || key == "yllcenter") {
+            info.yllCorner = v;
+        } else if (key == "cellsize") {
+            info.cellSize = v;
+        } else if (key == "nodata_value") {
+            info.hasNoData = true;
+            info.noData = v;
+        }
+        haveToken = tokens.next(start, end);
+    }
+    if (centered) {
+        info.xllCorner -= info.cellSize / 2;
+        info.yllCorner -= info.cellSize / 2;
+    }
+    if (!allocate(grid, info.rows, info.cols, "SLGridIO::loadAsciiGrid")) {
+        return false;
+    }
+
+    NoDataTracker noData;
+    for (int y = 0; y < info.rows; y++) {
+        float* z = grid[y].data();
+        for (int x = 0; x < info.cols; x++) {
+            double v;
+            if (!haveToken || parseNumber(start, end, v) != end) {
+                printf("::::ERROR:::: SLGridIO::loadAsciiGrid-> %s at row %d col %d in %s\n",
+                    haveToken ? "bad value" : "file ends", y, x, path.c_str());
+                return false;
+            }
+            z[x] = (info.hasNoData && v == info.noData) ? NAN : (float)v;
+            haveToken = tokens.next(start, end);
+        }
+        scaleRow(z, info.cols, params);
+        noData.row(z, info.cols);
+    }
+    noData.finish(grid, params, noDataMask);
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// raw with a sidecar header
+
+bool SLGridIO::readRawHeader(const std::string& path, RawFormat& format) {
+    std::string base = withoutExtension(path);
+    std::ifstream fin(base + ".hdr");
+    if (!fin.is_open()) {
+        fin.open(path + ".hdr");
+    }
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: SLGridIO::readRawHeader-> no %s.hdr next to %s\n", base.c_str(), path.c_str());
+        return false;
+    }
+
+    format = RawFormat();
+    GridInfo& info = format.info;
+    int bits = 0;
+    std::string pixelType;
+    double ulx = NAN, uly = NAN, xdim = NAN, ydim = NAN;
+    std::string key, value;
+    while (fin >> key) {
+        key = lower(key);
+        if (!(fin >> value)) {
+            break;
+        }
+        double v = std::atof(value.c_str());
+        if (key == "nrows") {
+            info.rows = (int)v;
+        } else if (key == "ncols") {
+            info.cols = (int)v;
+        } else if (key == "nbits") {
+            bits = (int)v;
+        } else if (key == "pixeltype") {
+            pixelType = lower(value);
+        } else if (key == "byteorder") {
+            std::string order = lower(value);
+            format.bigEndian = order == "m" || order == "msbfirst" || order == "big";
+        } else if (key == "skipbytes") {
+            format.skipBytes = (int64_t)v;
+        } else if (key == "nodata" || key == "nodata_value") {
+            info.hasNoData = true;
+            info.noData = v;
+        } else if (key == "ulxmap") {
+            ulx = v;
+        } else if (key == "ulymap") {
+            uly = v;
+        } else if (key == "xdim" || key == "cellsize") {
+            xdim = v;
+        } else if (key == "ydim") {
+            ydim = v;
+        } else if (key == "xllcorner") {
+            info.xllCorner = v;
+        } else if (key == "yllcorner") {
+            info.yllCorner = v;
+        }
+        std::getline(fin, value); // rest of the line (comments, units)
+    }
+
+    if (bits == 0) {
+        bits = pixelType == "float" ? 32 : 16;
+    }
+    // without a pixeltype: 8 bit unsigned, 16 bit signed, 32 and 64 bit float
+    const bool any = pixelType.empty();
+    const bool isFloat = any || pixelType == "float";
+    const bool isSigned = pixelType == "signedint";
+    const bool isUnsigned = pixelType == "unsignedint";
+    if (bits == 8 && (any || isUnsigned)) {
+        format.type = RAW_UINT8;
+    } else if (bits == 8 && isSigned) {
+        format.type = RAW_INT8;
+    } else if (bits == 16 && isUnsigned) {
+        format.type = RAW_UINT16;
+    } else if (bits == 16 && (any || isSigned)) {
+        format.type = RAW_INT16;
+    } else if (bits == 32 && isFloat) {
+        format.type = RAW_FLOAT32;
+    } else if (bits == 32 && isSigned) {
+        format.type = RAW_INT32;
+    } else if (bits == 32 && isUnsigned) {
+        format.type = RAW_UINT32;
+    } else if (bits == 64 && isFloat) {
+        format.type = RAW_FLOAT64;
+    } else if (bits == 64 && isSigned) {
+        format.type = RAW_INT64;
+    } else if (bits == 64 && isUnsigned) {
+        format.type = RAW_UINT64;
+    } else {
+        printf("::::ERROR:::: SLGridIO::readRawHeader-> unsupported %d bit %s pixels in %s\n", bits,
+            pixelType.empty() ? "default" : pixelType.c_str(), path.c_str());
+        return false;
+    }
+    if (!std::isnan(xdim)) {
+        info.cellSize = xdim;
+    }
+    if (std::isnan(ydim)) {
+        ydim = info.cellSize;
+    }
+    if (!std::isnan(ulx)) {
+        info.xllCorner = ulx - info.cellSize / 2; // ulxmap/ulymap are the upper left cell's centre
+    }
+    if (!std::isnan(uly)) {
+        info.yllCorner = uly + ydim / 2 - info.rows * ydim;
+    }
+    return true;
+}
+
+bool SLGridIO::loadRaw(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+    const ImportParams& params, std::vector<std::vector<uint8_t>>* noDataMask) {
+    RawFormat format;
+    if (!readRawHeader(path, format)) {
+        return false;
+    }
+    info = format.info;
+    return loadRaw(path, format, grid, params, noDataMask);
+}
+
+bool SLGridIO::loadRaw(const std::string& path, const RawFormat& format, std::vector<std::vector<float>>& grid,
+    const ImportParams& params, std::vector<std::vector<uint8_t>>* noDataMask) {
+    const GridInfo& info = format.info;
+    const int cols = info.cols;
+    void (*convert)(const uint8_t*, int, bool, bool, double, float*) = nullptr;
+    size_t elementSize = 0;
+    switch (format.type) {
+    case RAW_INT8: convert = rawToFloat<int8_t>; elementSize = 1; break;
+    case RAW_UINT8: convert = rawToFloat<uint8_t>; elementSize = 1; break;
+    case RAW_INT16: convert = rawToFloat<int16_t>; elementSize = 2; break;
+    case RAW_UINT16: convert = rawToFloat<uint16_t>; elementSize = 2; break;
+    case RAW_INT32: convert = rawToFloat<int32_t>; elementSize = 4; break;
+    case RAW_UINT32: convert = rawToFloat<uint32_t>; elementSize = 4; break;
+    case RAW_FLOAT32: convert = rawToFloat<float>; elementSize = 4; break;
+    case RAW_INT64: convert = rawToFloat<int64_t>; elementSize = 8; break;
+    case RAW_UINT64: convert = rawToFloat<uint64_t>; elementSize = 8; break;
+    case RAW_FLOAT64: convert = rawToFloat<double>; elementSize = 8; break;
+    }
+    if (!convert) {
+        printf("::::ERROR:::: SLGridIO::loadRaw-> unknown raw type %d for %s\n", (int)format.type, path.c_str());
+        return false;
+    }
+    const size_t rowBytes = (size_t)cols * elementSize;
+
+    std::ifstream fin(path, std::ios::binary | std::ios::ate);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: SLGridIO::loadRaw-> could not open %s\n", path.c_str());
+        return false;
+    }
+    if (!allocate(grid, info.rows, cols, "SLGridIO::loadRaw")) {
+        return false;
+    }
+    int64_t fileSize = (int64_t)fin.tellg();
+    if (fileSize < format.skipBytes + (int64_t)(rowBytes * info.rows)) {
+        printf("::::ERROR:::: SLGridIO::loadRaw-> %s is %lld bytes, %d x %d needs %lld\n", path.c_str(),
+            (long long)fileSize, cols, info.rows, (long long)(format.skipBytes + (int64_t)(rowBytes * info.rows)));
+        return false;
+    }
+    fin.seekg(format.skipBytes);
+
+    const bool swap = format.bigEndian != hostIsBigEndian();
+    const bool direct = format.type == RAW_FLOAT32 && !swap; // straight into the rows, no copy
+    const int bandRows = (int)std::max<size_t>(1, CHUNK_BYTES / rowBytes);
+    std::vector<uint8_t> band(direct ? 0 : bandRows * rowBytes);
+    NoDataTracker noData;
+
+    for (int y0 = 0; y0 < info.rows; y0 += bandRows) {
+        int y1 = std::min(info.rows, y0 + bandRows);
+        if (!direct) {
+            fin.read((char*)band.data(), (std::streamsize)((y1 - y0) * rowBytes));
+        }
+        for (int y = y0; y < y1; y++) {
+            float* z = grid[y].data();
+            if (direct) {
+                fin.read((char*)z, (std::streamsize)rowBytes);
+            }
+            if (!fin) {
+                printf("::::ERROR:::: SLGridIO::loadRaw-> read failed at row %d of %s\n", y, path.c_str());
+                return false;
+            }
+
+            if (!direct) {
+                convert(band.data() + (y - y0) * rowBytes, cols, swap, info.hasNoData, info.noData, z);
+            } else if (info.hasNoData) {
+                const float nd = (float)info.noData;
+                for (int x = 0; x < cols; x++) {
+                    z[x] = z[x] == nd ? NAN : z[x];
+                }
+            }
+            scaleRow(z, cols, params);
+            noData.row(z, cols);
+        }
+    }
+    noData.finish(grid, params, noDataMask);
+    return true;
+}
+
+//---------------------------------------------------------------------------------------------------
+// binary PGM
+
+bool SLGridIO::loadPgm(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+    const ImportParams& params, std::vector<std::vector<uint8_t>>* noDataMask) {
+    std::ifstream fin(path, std::ios::binary);
+    if (!fin.is_open()) {
+        printf("::::ERROR:::: SLGridIO::loadPgm-> could not open %s\n", path.c_str());
+        return false;
+    }
+    char magic[2] = {};
+    fin.read(magic, 2);
+    if (!fin || magic[0] != 'P' || magic[1] != '5') {
+        printf("::::ERROR:::: SLGridIO::loadPgm-> %s is not a binary (P5) PGM\n", path.c_str());
+        return false;
+    }
+    // width, height, maxval, with # comments anywhere between, then a single whitespace
+    int header[3] = {};
+    for (int i = 0; i < 3; i++) {
+        int c = fin.get();
+        while (c != EOF && (isSpace((char)c) || c == '#')) {
+            if (c == '#') {
+                while (c != EOF && c != '\n') {
+                    c = fin.get();
+                }
+            }
+            c = fin.get();
+        }
+        if (c < '0' || c > '9') {
+            printf("::::ERROR:::: SLGridIO::loadPgm-> bad header in %s\n", path.c_str());
+            return false;
+        }
+        for (; c >= '0' && c <= '9'; c = fin.get()) {
+            header[i] = std::min(header[i] * 10 + (c - '0'), 1 << 30);
+        }
+        if (!isSpace((char)c)) {
+            printf("::::ERROR:::: SLGridIO::loadPgm-> bad header in %s\n", path.c_str());
+            return false;
+        }
+    }
+    if (header[2] < 1 || header[2] > 65535) {
+        printf("::::ERROR:::: SLGridIO::loadPgm-> bad maxval %d in %s\n", header[2], path.c_str());
+        return false;
+    }
+
+    info = GridInfo();
+    info.cols = header[0];
+    info.rows = header[1];
+    if (!allocate(grid, info.rows, info.cols, "SLGridIO::loadPgm")) {
+        return false;
+    }
+    // PGM has no nodata of its own; the raw reader with a sidecar covers that
+    RawFormat format;
+    format.info = info;
+    format.type = RAW_UINT16;
+    format.bigEndian = true;
+    if (header[2] > 255) {
+        format.skipBytes = (int64_t)fin.tellg();
+        fin.close();
+        return loadRaw(path, format, grid, params, noDataMask);
+    }
+
+    // 8 bit
+    std::vector<uint8_t> row(info.cols);
+    NoDataTracker noData;
+    for (int y = 0; y < info.rows; y++) {
+        fin.read((char*)row.data(), info.cols);
+        if (!fin) {
+            printf("::::ERROR:::: SLGridIO::loadPgm-> read failed at row %d of %s\n", y, path.c_str());
+            return false;
+        }
+        float* z = grid[y].data();
+        for (int x = 0; x < info.cols; x++) {
+            z[x] = row[x];
+        }
+        scaleRow(z, info.cols, params);
+        noData.row(z, info.cols);
+    }
+    noData.finish(grid, params, noDataMask);
+    return true;
+}
+
+bool SLGridIO::loadGrid(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+    const ImportParams& params, std::vector<std::vector<uint8_t>>* noDataMask) {
+    std::string ext = extension(path);
+    if (ext == "asc") {
+        return loadAsciiGrid(path, grid, info, params, noDataMask);
+    }
+    if (ext == "pgm") {
+        return loadPgm(path, grid, info, params, noDataMask);
+    }
+    if (ext == "raw" || ext == "bil" || ext == "bin" || ext == "flt") {
+        return loadRaw(path, grid, info, params, noDataMask);
+    }
+    printf("::::ERROR:::: SLGridIO::loadGrid-> unknown format .%s of %s\n", ext.c_str(), path.c_str());
+    return false;
+}
+
+//---------------------------------------------------------------------------------------------------
+// export
+
+namespace {
+    size_t elementSize(uint32_t elementType) { return elementType & 0xFF; }
+    int elementKind(uint32_t elementType) { return (int)(elementType >> 8); }
+
+    // rows gathered into bands of about CHUNK_BYTES, each band one write. fill(row, dst) puts the
+    // row's bytes in the band
+    bool writeRows(std::ofstream& out, int rows, size_t rowBytes, const std::function<void(int, char*)>& fill) {
+        const int bandRows = (int)std::max<size_t>(1, CHUNK_BYTES / std::max<size_t>(1, rowBytes));
+        std::vector<char> band((size_t)std::min(bandRows, rows) * rowBytes);
+        for (int y0 = 0; y0 < rows; y0 += bandRows) {
+            int y1 = std::min(rows, y0 + bandRows);
+            for (int y = y0; y < y1; y++) {
+                fill(y, band.data() + (size_t)(y - y0) * rowBytes);
+            }
+            out.write(band.data(), (std::streamsize)((y1 - y0) * rowBytes));
+        }
+        return (bool)out;
+    }
+
+    // the row's memory as little-endian bytes: a copy, swapped per element on a big endian host
+    bool writeLittleEndianRows(std::ofstream& out, uint32_t elementType, int rows, int cols, const SLGridIO::RowSource& row) {
+        const size_t size = elementSize(elementType);
+        const size_t rowBytes = (size_t)cols * size;
+        const bool swap = hostIsBigEndian() && size > 1;
+        return writeRows(out, rows, rowBytes, [&](int y, char* dst) {
+            std::memcpy(dst, row(y), rowBytes);
+            if (swap) {
+                for (size_t i = 0; i < rowBytes; i += size) {
+                    std::reverse(dst + i, dst + i + size);
+                }
+            }
+        });
+    }
+
+    bool openForExport(std::ofstream& out, const std::string& path, uint32_t elementType, int rows, int cols, const char* func) {
+        size_t size = elementSize(elementType);
+        if (rows <= 0 || cols <= 0) {
+            printf("::::ERROR:::: %s-> nothing to export to %s (%d x %d)\n", func, path.c_str(), cols, rows);
+            return false;
+        }
+        if (size != 1 && size != 2 && size != 4 && size != 8) {
+            printf("::::ERROR:::: %s-> unsupported element size %d for %s\n", func, (int)size, path.c_str());
+            return false;
+        }
+        out.open(path, std::ios::binary);
+        if (!out.is_open()) {
+            printf("::::ERROR:::: %s-> could not open %s\n", func, path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    template <typename T>
+    void toPgm16(const char* src, int cols, double scale, double offset, char* dst) {
+        for (int x = 0; x < cols; x++) {
+            T value;
+            std::memcpy(&value, src + x * sizeof(T), sizeof(T));
+            double v = (double)value * scale + offset;
+            uint16_t level = v > 0 ? (uint16_t)std::min(65535.0, std::floor(v + 0.5)) : 0; // NaN to 0 too
+            dst[x * 2] = (char)(level >> 8); // PGM is big endian
+            dst[x * 2 + 1] = (char)(level & 0xFF);
+        }
+    }
+}
+
+bool SLGridIO::saveNpy(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row) {
+    std::ofstream fout;
+    if (!openForExport(fout, path, elementType, rows, cols, "SLGridIO::saveNpy")) {
+        return false;
+    }
+    const int kind = elementKind(elementType);
+    const size_t size = elementSize(elementType);
+    std::string descr = size == 1 ? "|" : "<";
+    descr += kind == SLContainer::KIND_FLOAT ? "f" : kind == SLContainer::KIND_SIGNED ? "i"
+        : kind == SLContainer::KIND_UNSIGNED ? "u" : "V";
+    descr += std::to_string(size);
+
+    // format 1.0: magic, version, header length, then a python dict padded with spaces so the data
+    // starts 64 byte aligned
+    std::string header = "{'descr': '" + descr + "', 'fortran_order': False, 'shape': (" + std::to_string(rows) + ", "
+        + std::to_string(cols) + "), }";
+    size_t total = 10 + header.size() + 1;
+    header.append((64 - total % 64) % 64, ' ');
+    header += '\n';
+    uint16_t headerSize = (uint16_t)header.size();
+    char preamble[10] = { (char)0x93, 'N', 'U', 'M', 'P', 'Y', 1, 0, (char)(headerSize & 0xFF), (char)(headerSize >> 8) };
+    fout.write(preamble, 10);
+    fout.write(header.data(), (std::streamsize)header.size());
+
+    if (!writeLittleEndianRows(fout, elementType, rows, cols, row)) {
+        printf("::::ERROR:::: SLGridIO::saveNpy-> write failed for %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SLGridIO::saveRaw(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row) {
+    std::ofstream fout;
+    if (elementKind(elementType) == SLContainer::KIND_FLOAT && elementSize(elementType) < 4) {
+        printf("::::ERROR:::: SLGridIO::saveRaw-> no raw pixel type for %d bit floats (%s)\n", (int)elementSize(elementType) * 8, path.c_str());
+        return false;
+    }
+    if (!openForExport(fout, path, elementType, rows, cols, "SLGridIO::saveRaw")) {
+        return false;
+    }
+    if (!writeLittleEndianRows(fout, elementType, rows, cols, row)) {
+        printf("::::ERROR:::: SLGridIO::saveRaw-> write failed for %s\n", path.c_str());
+        return false;
+    }
+
+    // ESRI style sidecar, next to it with .hdr for the extension (what readRawHeader looks for first)
+    std::string base = withoutExtension(path);
+    const int kind = elementKind(elementType);
+    std::ofstream hdr(base + ".hdr");
+    hdr << "nrows " << rows << "\nncols " << cols << "\nnbits " << elementSize(elementType) * 8
+        << "\npixeltype " << (kind == SLContainer::KIND_FLOAT ? "float" : kind == SLContainer::KIND_SIGNED ? "signedint" : "unsignedint")
+        << "\nbyteorder I\n";
+    if (!hdr) {
+        printf("::::ERROR:::: SLGridIO::saveRaw-> could not write %s.hdr\n", base.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool SLGridIO::savePgm16(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row,
+    double scale, double offset) {
+    std::ofstream fout;
+    if (!openForExport(fout, path, elementType, rows, cols, "SLGridIO::savePgm16")) {
+        return false;
+    }
+    void (*convert)(const char*, int, double, double, char*) = nullptr;
+    const int kind = elementKind(elementType);
+    switch (elementSize(elementType)) {
+    case 1: convert = kind == SLContainer::KIND_SIGNED ? toPgm16<int8_t> : toPgm16<uint8_t>; break;
+    case 2: convert = kind == SLContainer::KIND_SIGNED ? toPgm16<int16_t> : toPgm16<uint16_t>; break;
+    case 4: convert = kind == SLContainer::KIND_FLOAT ? toPgm16<float> : kind == SLContainer::KIND_SIGNED ? toPgm16<int32_t> : toPgm16<uint32_t>; break;
+    case 8: convert = kind == SLContainer::KIND_FLOAT ? toPgm16<double> : kind == SLContainer::KIND_SIGNED ? toPgm16<int64_t> : toPgm16<uint64_t>; break;
+    }
+
+    std::string header = "P5\n" + std::to_string(cols) + " " + std::to_string(rows) + "\n65535\n";
+    fout.write(header.data(), (std::streamsize)header.size());
+    if (!writeRows(fout, rows, (size_t)cols * 2, [&](int y, char* dst) { convert(row(y), cols, scale, offset, dst); })) {
+        printf("::::ERROR:::: SLGridIO::savePgm16-> write failed for %s\n", path.c_str());
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+#include "slcontainer.h"
+
+// SLGridIO---------------------------------------------------------------------------------------
+// Importing real elevation models (DEMs) as [row][col] height grids, row 0 the northern edge, e.g.
+// to build an SLHydrology from instead of generated fbm heights:
+//     std::vector<std::vector<float>> z;
+//     SLGridIO::GridInfo info;
+//     if (SLGridIO::loadGrid("dem.asc", z, info)) { SLHydrology hydro(z); ... }
+//
+// Formats:
+//   .asc       ESRI ASCII grid (ncols, nrows, xllcorner, yllcorner, cellsize, NODATA_value)
+//   .raw/.bil  headerless 8/16/32/64 bit integers or 32/64 bit floats with an ESRI style sidecar
+//              header next to it, converted to float heights
+//              (same name with .hdr: nrows, ncols, nbits, pixeltype, byteorder, skipbytes, nodata)
+//   .pgm       binary PGM (P5), 8 or 16 bit
+// Files are read in large chunks straight into the grid rows and ASCII numbers are parsed by hand
+// (no streams or stof), so multi-gigabyte DEMs load at disk speed.
+// Nodata cells are flagged in the optional mask and given a height (see ImportParams).
+//
+// Exporting any layer at full precision, for notebooks and engine pipelines (bitmaps are 8 bit):
+//   .npy       numpy array with the layer's own dtype (<f4, <i4, <u8...), np.load gives [row, col]
+//   raw        little-endian rows as they are in memory, plus a .hdr sidecar that loadRaw reads back
+//   .pgm       16 bit binary PGM of value * scale + offset, rounded and clamped to 0..65535
+// Works on grids and on SLGridView (a layer viewed straight from a save). Rows are gathered into
+// big bands and written in one go; npy and raw are plain copies of the row memory.
+// -----------------------------------------------------------------------------------------------
+
+namespace SLGridIO {
+    struct GridInfo {
+        int rows = 0;
+        int cols = 0;
+        double xllCorner = 0; // lower left corner in map units
+        double yllCorner = 0;
+        double cellSize = 1;
+        bool hasNoData = false;
+        double noData = 0;
+    };
+
+    struct ImportParams {
+        float scale = 1; // height = value * scale + offset (e.g. 16 bit PGM levels to metres)
+        float offset = 0;
+        // nodata cells get the lowest valid height so they drain like the map edge,
+        // or noDataHeight if this is off
+        bool fillNoDataWithMin = true;
+        float noDataHeight = 0;
+    };
+
+    enum RawType { RAW_INT16, RAW_UINT16, RAW_FLOAT32, RAW_INT8, RAW_UINT8, RAW_INT32, RAW_UINT32, RAW_INT64, RAW_UINT64, RAW_FLOAT64 };
+    struct RawFormat {
+        GridInfo info;
+        RawType type = RAW_FLOAT32;
+        bool bigEndian = false;
+        int64_t skipBytes = 0; // before the first row
+    };
+
+    // by extension (.asc, .raw/.bil/.bin/.flt, .pgm)
+    bool loadGrid(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+        const ImportParams& params = ImportParams(), std::vector<std::vector<uint8_t>>* noDataMask = nullptr);
+
+    bool loadAsciiGrid(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+        const ImportParams& params = ImportParams(), std::vector<std::vector<uint8_t>>* noDataMask = nullptr);
+
+    // reads the sidecar header (path with its extension swapped for .hdr, or path + ".hdr")
+    bool readRawHeader(const std::string& path, RawFormat& format);
+    bool loadRaw(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+        const ImportParams& params = ImportParams(), std::vector<std::vector<uint8_t>>* noDataMask = nullptr);
+    bool loadRaw(const std::string& path, const RawFormat& format, std::vector<std::vector<float>>& grid,
+        const ImportParams& params = ImportParams(), std::vector<std::vector<uint8_t>>* noDataMask = nullptr);
+
+    bool loadPgm(const std::string& path, std::vector<std::vector<float>>& grid, GridInfo& info,
+        const ImportParams& params = ImportParams(), std::vector<std::vector<uint8_t>>* noDataMask = nullptr);
+
+    // exporters over rows handed out by row(y), elementType as in SLContainer::elementTypeOf
+    typedef std::function<const char*(int row)> RowSource;
+    bool saveNpy(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row);
+    bool saveRaw(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row);
+    bool savePgm16(const std::string& path, uint32_t elementType, int rows, int cols, const RowSource& row,
+        double scale = 1, double offset = 0);
+
+    template <typename T>
+    bool rectangular(const std::vector<std::vector<T>>& grid) {
+        for (const std::vector<T>& r : grid) {
+            if (r.size() != grid[0].size()) {
+                printf("::::ERROR:::: SLGridIO-> grid is not rectangular\n");
+                return false;
+            }
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool saveNpy(const std::string& path, const std::vector<std::vector<T>>& grid) {
+        if (!rectangular(grid)) { return false; }
+        return saveNpy(path, SLContainer::elementTypeOf<T>(), (int)grid.size(), grid.empty() ? 0 : (int)grid[0].size(),
+            [&grid](int y) { return (const char*)grid[y].data(); });
+    }
+    template <typename T>
+    bool saveNpy(const std::string& path, const SLGridView<T>& view) {
+        return saveNpy(path, SLContainer::elementTypeOf<T>(), view.rows, view.cols, [&view](int y) { return (const char*)view[y]; });
+    }
+
+    template <typename T>
+    bool saveRaw(const std::string& path, const std::vector<std::vector<T>>& grid) {
+        if (!rectangular(grid)) { return false; }
+        return saveRaw(path, SLContainer::elementTypeOf<T>(), (int)grid.size(), grid.empty() ? 0 : (int)grid[0].size(),
+            [&grid](int y) { return (const char*)grid[y].data(); });
+    }
+    template <typename T>
+    bool saveRaw(const std::string& path, const SLGridView<T>& view) {
+        return saveRaw(path, SLContainer::elementTypeOf<T>(), view.rows, view.cols, [&view](int y) { return (const char*)view[y]; });
+    }
+
+    template <typename T>
+    bool savePgm16(const std::string& path, const std::vector<std::vector<T>>& grid, double scale = 1, double offset = 0) {
+        if (!rectangular(grid)) { return false; }
+        return savePgm16(path, SLContainer::elementTypeOf<T>(), (int)grid.size(), grid.empty() ? 0 : (int)grid[0].size(),
+            [&grid](int y) { return (const char*)grid[y].data(); }, scale, offset);
+    }
+    template <typename T>
+    bool savePgm16(const std::string& path, const SLGridView<T>& view, double scale = 1, double offset = 0) {
+        return savePgm16(path, SLContainer::elementTypeOf<T>(), view.rows, view.cols,
+            [&view](int y) { return (const char*)view[y]; }, scale, offset);
+    }
+
+    // the number parser used for ASCII grids: [+-]digits[.digits][e[+-]digits], "nan"/"inf" not
+    // accepted. returns the end of the number, or start if there isn't one
+    const char* parseNumber(const char* start, const char* end, double& value);
+}
@@ -1,8 +1,25 @@
 #include "slmath.h"
+#include <thread>
 
 // static initialization
 std::mt19937 SLMath::SLRng::gen;
 
+// rows are independent, so this can be split across threads without changing the output
+void SLMath::SLCounterRng::fillFloat(std::vector<std::vector<float>>& grid, uint32_t stage, float min, float max) const {
+    if (grid.size() == 0) { return; }
+    uint64_t cols = grid[0].size();
+    uint64_t key = streamKey(stage); // once per grid, not per cell
+    float range = max - min;
+
+    for (uint64_t i = 0; i < grid.size(); i++) {
+        float* row = grid[i].data();
+        for (uint64_t j = 0; j < cols; j++) {
+            uint64_t raw = splitMix64(key + (i * cols + j) * 0x9E3779B97F4A7C15ull);
+            row[j] = min + ((raw >> 40) * (1.0f / 16777216.0f)) * range;
+        }
+    }
+}
+
 // calculated distance
 float SLMath::distance2D(float x1, float y1, float x2, float y2) {
     float dx = x1 - x2;
@@ -109,3 +126,156 @@ void SLMath::blurAvg(std::vector<std::vector<float>>& matrix, int iterations) {
     }
 
 }
+
+void SLMath::parallelFor(int begin, int end, int threads, const std::function<void(int, int)>& body) {
+    int count = end - begin;
+    if (threads > count) { threads = count; }
+    if (threads <= 1) {
+        if (count > 0) { body(begin, end); }
+        return;
+    }
+
+    std::vector<std::thread> pool;
+    for (int t = 1; t < threads; t++) {
+        pool.push_back(std::thread(body, begin + (int)((int64_t)count * t / threads), begin + (int)((int64_t)count * (t + 1) / threads)));
+    }
+    body(begin, begin + count / threads); // first chunk on this thread
+    for (auto& thread : pool) {
+        thread.join();
+    }
+}
+
+void SLMath::SLPointIndex::reset(int width, int height, int bucketSize) {
+    _bucketSize = std::max(1, bucketSize);
+    _bucketCols = std::max(1, (width + _bucketSize - 1) / _bucketSize);
+    _bucketRows = std::max(1, (height + _bucketSize - 1) / _bucketSize);
+    _buckets.assign(_bucketCols * _bucketRows, std::vector<SLPoint>());
+    _size = 0;
+}
+
+void SLMath::SLPointIndex::clear() {
+    for (auto& bucket : _buckets) {
+        bucket.clear();
+    }
+    _size = 0;
+}
+
+void SLMath::SLPointIndex::insert(SLPoint p) {
+    _buckets[bucketY(p.y) * _bucketCols + bucketX(p.x)].push_back(p);
+    _size++;
+}
+
+bool SLMath::SLPointIndex::remove(SLPoint p) {
+    auto& bucket = _buckets[bucketY(p.y) * _bucketCols + bucketX(p.x)];
+    for (size_t i = 0; i < bucket.size(); i++) {
+        if (bucket[i] == p) {
+            bucket[i] = bucket.back();
+            bucket.pop_back();
+            _size--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SLMath::SLPointIndex::contains(SLPoint p) const {
+    for (auto& q : _buckets[bucketY(p.y) * _bucketCols + bucketX(p.x)]) {
+        if (q.x == p.x && q.y == p.y) { return true; }
+    }
+    return false;
+}
+
+// searches rings of buckets outwards from the one holding from. every bucket in ring r + 1 is at
+// least r * bucketSize away (less however far from is outside the area), so once k points closer
+// than that are found the rest can't win
+std::vector<SLMath::SLPoint> SLMath::SLPointIndex::nearest(SLPoint from, int k) const {
+    struct Candidate {
+        int64_t d2;
+        SLPoint p;
+        bool operator<(const Candidate& c) const {
+            if (d2 != c.d2) { return d2 < c.d2; }
+            return p.y != c.p.y ? p.y < c.p.y : p.x < c.p.x;
+        }
+    };
+    std::vector<Candidate> candidates;
+    std::vector<SLPoint> result;
+    if (k <= 0 || _size == 0) {
+        return result;
+    }
+
+    int bx = bucketX(from.x);
+    int by = bucketY(from.y);
+    // from can be outside the indexed area (its bucket is clamped), which shrinks the ring bound
+    int64_t outsideX = std::max<int64_t>(std::max<int64_t>(0, -(int64_t)from.x), (int64_t)from.x - ((int64_t)_bucketCols * _bucketSize - 1));
+    int64_t outsideY = std::max<int64_t>(std::max<int64_t>(0, -(int64_t)from.y), (int64_t)from.y - ((int64_t)_bucketRows * _bucketSize - 1));
+    int64_t outside = std::max(outsideX, outsideY);
+    int maxRing = std::max(std::max(bx, _bucketCols - 1 - bx), std::max(by, _bucketRows - 1 - by));
+    for (int r = 0; r <= maxRing; r++) {
+        for (int y = by - r; y <= by + r; y++) {
+            if (y < 0 || y >= _bucketRows) { continue; }
+            bool edgeRow = y == by - r || y == by + r;
+            for (int x = bx - r; x <= bx + r; x += (edgeRow ? 1 : 2 * r)) { // only the ring itself
+                if (x >= 0 && x < _bucketCols) {
+                    for (auto& p : _buckets[y * _bucketCols + x]) {
+                        int64_t dx = p.x - from.x;
+                        int64_t dy = p.y - from.y;
+                        candidates.push_back({ dx * dx + dy * dy, p });
+                    }
+                }
+            }
+        }
+
+        if ((int)candidates.size() >= k) {
+            std::nth_element(candidates.begin(), candidates.begin() + (k - 1), candidates.end());
+            int64_t reach = (int64_t)r * _bucketSize - outside;
+            // strictly closer: a point at exactly reach could still win the (y, x) tie-break
+            if (reach > 0 && candidates[k - 1].d2 < reach * reach) {
+                break;
+            }
+        }
+    }
+
+    int count = std::min(k, (int)candidates.size());
+    std::partial_sort(candidates.begin(), candidates.begin() + count, candidates.end());
+    for (int i = 0; i < count; i++) {
+        result.push_back(candidates[i].p);
+    }
+    return result;
+}
+
+std::vector<SLMath::SLPoint> SLMath::SLPointIndex::withinRadius(SLPoint center, float radius) const {
+    std::vector<SLPoint> result;
+    if (radius < 0) {
+        return result;
+    }
+    int reach = (int)std::ceil(radius);
+    double r2 = (double)radius * radius;
+    for (int y = bucketY(center.y - reach); y <= bucketY(center.y + reach); y++) {
+        for (int x = bucketX(center.x - reach); x <= bucketX(center.x + reach); x++) {
+            for (auto& p : _buckets[y * _bucketCols + x]) {
+                double dx = p.x - center.x;
+                double dy = p.y - center.y;
+                if (dx * dx + dy * dy <= r2) {
+                    result.push_back(p);
+                }
+            }
+        }
+    }
+    return result;
+}
+
+std::vector<SLMath::SLPoint> SLMath::SLPointIndex::withinRect(int x0, int y0, int x1, int y1) const {
+    std::vector<SLPoint> result;
+    if (x0 > x1) { std::swap(x0, x1); }
+    if (y0 > y1) { std::swap(y0, y1); }
+    for (int y = bucketY(y0); y <= bucketY(y1); y++) {
+        for (int x = bucketX(x0); x <= bucketX(x1); x++) {
+            for (auto& p : _buckets[y * _bucketCols + x]) {
+                if (p.x >= x0 && p.x <= x1 && p.y >= y0 && p.y <= y1) {
+                    result.push_back(p);
+                }
+            }
+        }
+    }
+    return result;
+}
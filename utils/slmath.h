@@ -1,9 +1,11 @@
 #pragma once
 #include <cmath>
+#include <cstdint>
 #include <vector>
 #include <algorithm>
 #include <fstream>
 #include <random>
+#include <functional>
 
 namespace SLMath {
 
@@ -42,7 +44,60 @@ namespace SLMath {
     private:
         static std::mt19937 gen;
     };
-    
+
+    // Counter-based RNG (SplitMix64 mixing as a hash).
+    // Holds no stream state: every draw is a pure function of (seed, year, stage, index),
+    // so per-cell loops get the same values whatever the iteration order or thread count.
+    // Use the cell index (i * cols + j) as the index and a separate stage for each kind of draw.
+    class SLCounterRng {
+    public:
+        SLCounterRng(uint64_t seed = 0, uint32_t year = 0) : _seed(seed), _year(year) {}
+
+        void setSeed(uint64_t seed) { _seed = seed; }
+        void setYear(uint32_t year) { _year = year; }
+        uint64_t getSeed() const { return _seed; }
+        uint32_t getYear() const { return _year; }
+
+        // seed hashed on its own first, so neighbouring seeds don't share streams across stages
+        uint64_t streamKey(uint32_t stage) const {
+            return splitMix64(combine(combine(splitMix64(_seed), _year), stage));
+        }
+        uint64_t getRaw(uint32_t stage, uint64_t index) const {
+            return splitMix64(streamKey(stage) + index * 0x9E3779B97F4A7C15ull);
+        }
+        // [min, max) using the top 24 bits (full float mantissa)
+        float getFloat(uint32_t stage, uint64_t index, float min, float max) const {
+            float u = (getRaw(stage, index) >> 40) * (1.0f / 16777216.0f);
+            return min + u * (max - min);
+        }
+        // [min, max] inclusive, same as std::uniform_int_distribution
+        int getInt(uint32_t stage, uint64_t index, int min, int max) const {
+            uint64_t range = (uint64_t)((int64_t)max - (int64_t)min) + 1;
+            return (int)(min + (int64_t)(getRaw(stage, index) % range));
+        }
+        bool getBool(uint32_t stage, uint64_t index) const {
+            return getRaw(stage, index) >> 63;
+        }
+
+        // bulk fill of a [y][x] grid, cell (i, j) gets the same value as getFloat(stage, i * cols + j, ...)
+        void fillFloat(std::vector<std::vector<float>>& grid, uint32_t stage, float min, float max) const;
+
+        // for building a single index out of several counters (e.g. fire, iteration, cell)
+        static uint64_t combine(uint64_t a, uint64_t b) {
+            return splitMix64(a + 0x9E3779B97F4A7C15ull) ^ b;
+        }
+        static uint64_t splitMix64(uint64_t x) {
+            x += 0x9E3779B97F4A7C15ull;
+            x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+            x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+            return x ^ (x >> 31);
+        }
+
+    private:
+        uint64_t _seed;
+        uint32_t _year;
+    };
+
 
     // for basic point storage wihtout operators
     struct SLPoint {
@@ -227,6 +282,35 @@ namespace SLMath {
         }
     };
 
+    // uniform grid of buckets over a width x height area, for finding points near a position
+    // without scanning them all. points outside the area go in the nearest edge bucket
+    class SLPointIndex {
+    public:
+        SLPointIndex(int width = 0, int height = 0, int bucketSize = 16) { reset(width, height, bucketSize); }
+        void reset(int width, int height, int bucketSize = 16); // also empties the index
+        void clear();
+        void insert(SLPoint p);
+        bool remove(SLPoint p); // removes one copy, false if p isn't in the index
+        bool contains(SLPoint p) const;
+        int size() const { return _size; }
+
+        // up to k points, closest first (equal distances by y then x)
+        std::vector<SLPoint> nearest(SLPoint from, int k) const;
+        // in no particular order
+        std::vector<SLPoint> withinRadius(SLPoint center, float radius) const;
+        std::vector<SLPoint> withinRect(int x0, int y0, int x1, int y1) const; // inclusive
+
+    private:
+        int _bucketSize = 16;
+        int _bucketCols = 1;
+        int _bucketRows = 1;
+        int _size = 0;
+        std::vector<std::vector<SLPoint>> _buckets; // [by * _bucketCols + bx]
+        int bucketX(int x) const { return clampBucket(x / _bucketSize, _bucketCols); }
+        int bucketY(int y) const { return clampBucket(y / _bucketSize, _bucketRows); }
+        static int clampBucket(int b, int count) { return b < 0 ? 0 : (b >= count ? count - 1 : b); }
+    };
+
     // END STUCTS AND CLASSES ----------------------------------------------------------------------------------------
 
 
@@ -262,8 +346,12 @@ namespace SLMath {
     void blur(std::vector<std::vector<float>>& matrix, int iterations, float amountPerIter);
     void blurAvg(std::vector<std::vector<float>>& matrix, int iterations);
 
+    // splits [begin, end) into one contiguous chunk per thread and runs body(chunkBegin, chunkEnd)
+    // on each, returning when all are done (threads <= 1 just runs it on the calling thread)
+    void parallelFor(int begin, int end, int threads, const std::function<void(int, int)>& body);
+
     template <typename T>
-    bool saveVector(std::vector<T>& vector, std::ofstream& fout) {
+    bool saveVector(std::vector<T>& vector, std::ostream& fout) {
         //TODO-->checks
         printf(":SAVE MATRIX:\n");
         int size = (int)(vector.size());
@@ -271,34 +359,51 @@ namespace SLMath {
 
         printf("SSize of T: %d\n", sizeof(T));
         printf("SSize of vector: %d\n", size);
-        fout.write((char*)(&vector[0]), size * sizeof(T));
+        fout.write((char*)(vector.data()), size * sizeof(T));
         return true;
     }
 
 
     template <typename T>
-    bool loadVector(std::vector<T>& vector, std::ifstream& fin) {
+    bool loadVector(std::vector<T>& vector, std::istream& fin) {
         //TODO-->checks
         printf(":LOAD MATRIX:\n");
-        int size;
+        int size = 0;
         fin.read((char*)(&size), sizeof(int));
+        if (!fin || size < 0) { // truncated or not this kind of file
+            vector.clear();
+            return false;
+        }
 
         printf("Size of T: %d\n", sizeof(T));
         printf("Size of vector: %d\n", size);
 
         vector = std::vector<T>(size);
 
-        fin.read((char*)(&vector[0]), size * sizeof(T));
-        return true;
+        fin.read((char*)(vector.data()), size * sizeof(T));
+        return fin.good();
+    }
+
+
+    // single trivially copyable values (param structs, counters)
+    template <typename T>
+    bool saveValue(const T& value, std::ostream& fout) {
+        fout.write((const char*)(&value), sizeof(T));
+        return fout.good();
     }
 
+    template <typename T>
+    bool loadValue(T& value, std::istream& fin) {
+        fin.read((char*)(&value), sizeof(T));
+        return fin.good();
+    }
 
     template <typename T>
-    bool saveMatrix(std::vector<std::vector<T>>& matrix, std::ofstream& fout) {
+    bool saveMatrix(std::vector<std::vector<T>>& matrix, std::ostream& fout) {
         //TODO-->checks
         printf(":SAVE MATRIX:\n");
         int sizeY = (int)(matrix.size());
-        int sizeX = (int)(matrix[0].size());
+        int sizeX = sizeY > 0 ? (int)(matrix[0].size()) : 0; // unbuilt layers are empty
         fout.write((char*)(&sizeY), sizeof(int));
         fout.write((char*)(&sizeX), sizeof(int));
 
@@ -312,12 +417,16 @@ namespace SLMath {
     }
 
     template <typename T>
-    bool loadMatrix(std::vector<std::vector<T>>& matrix, std::ifstream& fin) {
+    bool loadMatrix(std::vector<std::vector<T>>& matrix, std::istream& fin) {
         //TODO-->checks
         printf(":LOAD MATRIX:\n");
-        int y, x;
+        int y = 0, x = 0;
         fin.read((char*)(&y), sizeof(int));
         fin.read((char*)(&x), sizeof(int));
+        if (!fin || y < 0 || x < 0) { // truncated or not this kind of file
+            matrix.clear();
+            return false;
+        }
 
         printf("Size of T: %d\n", sizeof(T));
         printf("Size of matrix: %d, %d\n", y, x);
@@ -325,9 +434,9 @@ namespace SLMath {
         matrix = std::vector <std::vector<T>>(y, std::vector<T>(x));
 
         for (int i = 0; i < y; i++) {
-            fin.read((char*)(&matrix[i][0]), x * sizeof(T));
+            fin.read((char*)(matrix[i].data()), x * sizeof(T));
         }
-        return true;
+        return fin.good();
     }
     // END FUNCTIONALITY -----------------------------------------------------------------------------------------------
 
@@ -335,12 +444,19 @@ namespace SLMath {
     class PerlinNoise2D {
     public:
         // where did I get this from?
-        PerlinNoise2D() {
+        PerlinNoise2D() : PerlinNoise2D(0) {}
+
+        // permutation table shuffled from the seed only (no shared rand() state),
+        // so noise generators can be built on several threads at once
+        PerlinNoise2D(uint64_t seed) {
             // initialize permutation table
             for (int i = 0; i < 256; ++i) {
                 p[i] = i;
             }
-            std::random_shuffle(p, p + 256);
+            SLCounterRng rng(seed);
+            for (int i = 255; i > 0; --i) { // Fisher-Yates
+                std::swap(p[i], p[rng.getInt(0, i, 0, i)]);
+            }
             for (int i = 0; i < 256; ++i) {
                 p[256 + i] = p[i];
             }